@@ -26,18 +26,24 @@
 #include "memory_types.hpp"
 #include "entity_cache.hpp"
 #include "order_entity.hpp"
+#include <limits>
 
 using mpclmi::ipc::Shared;
 using ipc::data::order_entity;
 
 namespace interactive {
 
+	static const std::size_t PAGE_SIZE = 1024;
+
 	OrderBookCache::collection_t INTERACTIVE_DLL_EXPORTS
 		OrderBookCache::GetEntries() {
 		std::vector<std::shared_ptr < OrderContract>> entries;
 		using Cache = datacache::entity_cache<Shared, ipc::data::order_container>;
+		using Tag = typename ipc::data::order_entity<Cache::char_allocator>::order_tag;
 		Cache ipc_order_book(cache_name_);
-		ipc_order_book.retrieve(entries);
+		// page through the book so the order manager is not held off for the whole copy
+		auto cursor = datacache::make_range_cursor(std::numeric_limits<long>::min(), std::numeric_limits<long>::max());
+		while (ipc_order_book.retrieve_page<Tag>(entries, cursor, PAGE_SIZE)) {}
 		return entries;
 	}
 
@@ -52,6 +58,25 @@ namespace interactive {
 		return entries;
 	}
 
+	OrderBookCache::collection_t INTERACTIVE_DLL_EXPORTS
+		OrderBookCache::GetEntriesByOrderIds(const std::vector<long> &order_ids) {
+		using Cache = datacache::entity_cache<Shared, ipc::data::order_container>;
+		using Tag = typename ipc::data::order_entity<Cache::char_allocator>::order_tag;
+		std::vector<std::shared_ptr < OrderContract>> entries;
+		Cache ipc_order_book(cache_name_);
+		ipc_order_book.retrieve_many<Tag>(entries, order_ids);
+		return entries;
+	}
+
+	OrderBookCache::collection_t INTERACTIVE_DLL_EXPORTS
+		OrderBookCache::GetOpenEntriesByAccount(const std::string &account) {
+		using Cache = datacache::entity_cache<Shared, ipc::data::order_container>;
+		std::vector<std::shared_ptr < OrderContract>> entries;
+		Cache ipc_order_book(cache_name_);
+		ipc::data::open_orders(ipc_order_book, entries, account);
+		return entries;
+	}
+
 }
 
 
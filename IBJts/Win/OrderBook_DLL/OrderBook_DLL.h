@@ -47,6 +47,8 @@ namespace interactive {
 		}
 		collection_t  GetEntries();
 		collection_t  GetEntriesByAccount(const std::string &account);
+		collection_t  GetEntriesByOrderIds(const std::vector<long> &order_ids);
+		collection_t  GetOpenEntriesByAccount(const std::string &account);
 	private:
 		std::string cache_name_;
 	};
@@ -0,0 +1,148 @@
+/*
+ * File:   batching_socket.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 2:40 PM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __INTERACTIVE_BATCHING_SOCKET_HPP__
+#define __INTERACTIVE_BATCHING_SOCKET_HPP__
+
+#include <EPosixClientSocket.h>
+#include <EPosixClientSocketPlatform.h>
+#include <cstddef>
+#include <vector>
+
+#if !defined ( _WIN32 )
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace interactive {
+
+/*
+ * EPosixClientSocket that can hold its output.
+ * Every request of the EClient API is encoded and sent on its own , between hold()
+ * and flush() the encoded requests are appended to one buffer instead and flush()
+ * hands the whole batch to the kernel with a single send. With cork() the socket is
+ * also corked while a batch is held , where TCP_CORK or TCP_NOPUSH exist.
+ * Output the socket did not take stays in the buffer , later requests queue behind
+ * it and pending() tells the dispatcher to wait for writable and call on_writable().
+ * Dispatcher thread only , like the socket it extends.
+ */
+class batching_socket : public EPosixClientSocket {
+public:
+    explicit batching_socket(EWrapper *wrapper) : EPosixClientSocket(wrapper), _batch(), _holding(false), _cork(false) {}
+
+    void eDisconnect() {
+        _batch.clear() ;
+        _holding = false ;
+        EPosixClientSocket::eDisconnect() ;
+    }
+
+    void cork(bool on) {
+        _cork = on ;
+    }
+
+    // requests from here on are held until flush()
+    void hold() {
+        if ( _holding ) {
+            return ;
+        }
+        _holding = true ;
+        set_cork(true) ;
+    }
+
+    // sends what is held , false once the socket failed and was disconnected
+    bool flush() {
+        _holding = false ;
+        bool ok = send_batch() ;
+        set_cork(false) ;
+        return ok ;
+    }
+
+    bool pending() const {
+        return !_batch.empty() || !isOutBufferEmpty() ;
+    }
+
+    // the socket is writable again , our buffer goes first , it holds the older output
+    void on_writable() {
+        if ( send_batch() ) {
+            onSend() ;
+        }
+    }
+
+private:
+    // every encoded request of EClientSocketBase ends up here
+    int send(const char *buf, size_t sz) {
+        if ( sz <= 0 ) {
+            return 0 ;
+        }
+        if ( _holding || !_batch.empty() ) {
+            _batch.insert(_batch.end(), buf, buf + sz) ;
+            return static_cast<int>(sz) ;
+        }
+        return send_now(buf, sz) ;
+    }
+
+    // what EPosixClientSocket::send does , it is private there
+    int send_now(const char *buf, std::size_t sz) {
+        int n = ::send(fd(), buf, sz, 0) ;
+        if ( n == -1 && !handleSocketError() ) {
+            return -1 ;
+        }
+        return n <= 0 ? 0 : n ;
+    }
+
+    bool send_batch() {
+        std::size_t sent {} ;
+        while ( sent < _batch.size() && fd() >= 0 ) {
+            int n = send_now(_batch.data() + sent, _batch.size() - sent) ;
+            if ( n <= 0 ) {
+                break ; // would block , or failed and disconnected
+            }
+            sent += static_cast<std::size_t>(n) ;
+        }
+        if ( fd() < 0 ) {
+            _batch.clear() ;
+            return false ;
+        }
+        _batch.erase(_batch.begin(), _batch.begin() + sent) ;
+        return true ;
+    }
+
+    void set_cork(bool on) {
+        if ( !_cork || fd() < 0 ) {
+            return ;
+        }
+        int value = on ? 1 : 0 ;
+#if defined ( TCP_CORK )
+        ::setsockopt(fd(), IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) ;
+#elif defined ( TCP_NOPUSH )
+        ::setsockopt(fd(), IPPROTO_TCP, TCP_NOPUSH, &value, sizeof(value)) ;
+#else
+        (void)value ;
+#endif
+    }
+
+    std::vector<char> _batch ;
+    bool _holding ;
+    bool _cork ;
+};
+
+}
+
+#endif /* __INTERACTIVE_BATCHING_SOCKET_HPP__ */
@@ -0,0 +1,152 @@
+/* 
+ * File:   cache_bench.cpp
+ * Author: Vladimr Venediktov
+ *
+ * Created on October 17, 2026, 10:40 PM
+ *
+ * Point lookup latency of the order cache by order_id ,
+ * ordered_unique (order_container) vs hashed_unique (order_hashed_container) primary index ,
+ * and the ordered index on 4KB pages (Shared) vs huge pages (HugePage).
+ */
+
+#include "Contract.h"
+#include "Order.h"
+
+#include "memory_types.hpp"
+#include "order_entity.hpp"
+#include "entity_cache.hpp"
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using mpclmi::ipc::Shared;
+using mpclmi::ipc::HugePage;
+using interactive::OrderContract;
+
+namespace {
+
+const std::size_t BATCH_SIZE = 10000 ;
+
+std::vector<OrderContract> make_orders(long from, long to) {
+    std::vector<OrderContract> orders ;
+    orders.reserve(to - from) ;
+    for ( long id = from ; id < to ; ++id ) {
+        Order order ;
+        Contract contract ;
+        contract.symbol = id % 2 ? "IBM" : "MSFT" ;
+        contract.secType = "STK" ;
+        contract.exchange = "ARCA" ;
+        contract.currency = "USD" ;
+        order.account = "DUC0007" + std::to_string(id % 5) ;
+        order.action = "BUY" ;
+        order.totalQuantity = 100 ;
+        order.orderType = "LMT" ;
+        order.lmtPrice = 0.01 ;
+        order.orderId = id ;
+        orders.emplace_back(order, contract) ;
+    }
+    return orders ;
+}
+
+void remove_segment(Shared, const std::string &name) {
+    boost::interprocess::shared_memory_object::remove(name.c_str()) ;
+}
+
+void remove_segment(HugePage, const std::string &name) {
+    std::remove(HugePage::resolve(HugePage::convert_base_dir("") + name).c_str()) ;
+}
+
+const char * mode_name(mpclmi::ipc::huge_page_mode mode) {
+    switch ( mode ) {
+        case mpclmi::ipc::huge_page_mode::hugetlbfs : return "hugetlbfs" ;
+        case mpclmi::ipc::huge_page_mode::thp : return "transparent huge pages" ;
+        default : return "unavailable , HugePage runs on 4KB pages" ;
+    }
+}
+
+template<typename Memory, template <class> class Container>
+double lookup_ns(const std::string &name, std::size_t live_orders, std::size_t lookups) {
+    using Cache = datacache::entity_cache<Memory, Container> ;
+    using Tag = typename ipc::data::order_entity<typename Cache::char_allocator>::order_tag ;
+    remove_segment(Memory(), name) ;
+    double ns {} ;
+    {
+        Cache cache(name) ;
+        for ( std::size_t from = 1 ; from <= live_orders ; from += BATCH_SIZE ) {
+            cache.insert(make_orders(from, std::min(from + BATCH_SIZE, live_orders + 1))) ;
+        }
+        std::mt19937_64 rng(live_orders) ;
+        std::uniform_int_distribution<long> ids(1, live_orders) ;
+        std::vector<long> keys(lookups) ;
+        std::generate(keys.begin(), keys.end(), [&]() { return ids(rng); }) ;
+
+        std::size_t found {} ;
+        auto start = std::chrono::steady_clock::now() ;
+        for ( long key : keys ) {
+            found += cache.template visit<Tag>(key, [](const typename Cache::Data_t &) {}) ;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start ;
+        if ( found != lookups ) {
+            std::cerr << name << ": found " << found << " of " << lookups << std::endl ;
+        }
+        ns = std::chrono::duration<double, std::nano>(elapsed).count() / lookups ;
+    }
+    remove_segment(Memory(), name) ;
+    return ns ;
+}
+
+}
+
+int main(int argc, char **argv) {
+    po::variables_map vm;
+    po::options_description desc("Allowed options");
+    std::string sizes ;
+    std::size_t lookups ;
+    desc.add_options()
+            ("help,h", "display help screen")
+            ("orders,n", po::value<std::string>(&sizes)->default_value("10000,100000,1000000"), "comma separated numbers of live orders")
+            ("lookups,l", po::value<std::size_t>(&lookups)->default_value(1000000), "number of random order_id lookups per run");
+
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const boost::program_options::error &e) {
+        std::cerr << desc << std::endl;
+        return -1;
+    }
+    if (vm.count("help") ) {
+        std::clog << desc << std::endl;
+        return 0;
+    }
+
+    std::vector<std::string> tokens ;
+    boost::split(tokens, sizes, boost::is_any_of(","), boost::token_compress_on) ;
+
+    std::cout << std::setw(12) << "orders"
+              << std::setw(16) << "ordered ns/op"
+              << std::setw(16) << "hashed ns/op"
+              << std::setw(18) << "hugepage ns/op" << std::endl ;
+    for ( const auto &token : tokens ) {
+        std::size_t live_orders = boost::lexical_cast<std::size_t>(token) ;
+        double ordered = lookup_ns<Shared, ipc::data::order_container>("cache_bench_ordered", live_orders, lookups) ;
+        double hashed  = lookup_ns<Shared, ipc::data::order_hashed_container>("cache_bench_hashed", live_orders, lookups) ;
+        double huge    = lookup_ns<HugePage, ipc::data::order_container>("cache_bench_huge", live_orders, lookups) ;
+        std::cout << std::setw(12) << live_orders
+                  << std::setw(16) << std::fixed << std::setprecision(1) << ordered
+                  << std::setw(16) << hashed
+                  << std::setw(18) << huge << std::endl ;
+    }
+    // after the runs , a hugetlbfs pool too small for the segment moves it to /dev/shm
+    std::cout << "huge pages: " << mode_name(HugePage::mode()) << std::endl ;
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * File:   cache_stats.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 5:20 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __DATACACHE_CACHE_STATS_HPP__
+#define __DATACACHE_CACHE_STATS_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace datacache {
+
+enum class cache_op : std::uint8_t {
+    insert = 0,
+    update = 1,
+    modify = 2,
+    erase = 3,
+    retrieve = 4,
+    visit = 5,
+    clear = 6,
+    scan = 7
+};
+
+static const std::size_t CACHE_OP_COUNT = 8 ;
+static const std::size_t MAX_INDEXES = 8 ; // per index counters , indexes past it are folded into the last one
+static const std::size_t HISTOGRAM_BUCKETS = 32 ; // bucket i counts durations in [2^(i-1), 2^i) ns
+
+/*
+ * Plain copies of the counters for whoever reads them , see cache_stats::snapshot .
+ */
+struct histogram_snapshot {
+    std::uint64_t buckets[HISTOGRAM_BUCKETS] ;
+    std::uint64_t count() const {
+        std::uint64_t n {} ;
+        for ( auto b : buckets ) { n += b ; }
+        return n ;
+    }
+    // upper bound in ns of the bucket holding the given quantile , 0 when empty
+    std::uint64_t quantile(double q) const {
+        std::uint64_t total = count() , seen {} ;
+        for ( std::size_t i = 0 ; i < HISTOGRAM_BUCKETS && total ; ++i ) {
+            seen += buckets[i] ;
+            if ( seen >= q * total ) {
+                return std::uint64_t(1) << i ;
+            }
+        }
+        return 0 ;
+    }
+};
+
+struct op_snapshot {
+    std::uint64_t count ;
+    std::uint64_t hits ;
+    std::uint64_t misses ;
+    std::uint64_t bytes ; // blob bytes encoded by writes , decoded by reads
+    std::uint64_t by_index[MAX_INDEXES] ;
+    histogram_snapshot lock_wait ;
+    histogram_snapshot lock_hold ;
+};
+
+struct cache_stats_snapshot {
+    op_snapshot ops[CACHE_OP_COUNT] ;
+    std::uint64_t grow_events ;
+    std::uint64_t grow_bytes ;
+    std::uint64_t segment_size ;
+    std::uint64_t min_free_memory ; // segment_size - min_free_memory is the high-water mark of use
+    const op_snapshot & operator[](cache_op op) const {
+        return ops[static_cast<std::size_t>(op)] ;
+    }
+};
+
+/*
+ * Log2 latency histogram , lock free so every process can record into it.
+ */
+struct log2_histogram {
+    log2_histogram() {
+        for ( auto &b : buckets ) { b.store(0, std::memory_order_relaxed) ; }
+    }
+    void record(std::uint64_t ns) {
+        std::size_t bucket {} ;
+        while ( ns && bucket < HISTOGRAM_BUCKETS - 1 ) {
+            ns >>= 1 ;
+            ++bucket ;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed) ;
+    }
+    void copy(histogram_snapshot &out) const {
+        for ( std::size_t i = 0 ; i < HISTOGRAM_BUCKETS ; ++i ) {
+            out.buckets[i] = buckets[i].load(std::memory_order_relaxed) ;
+        }
+    }
+    std::atomic<std::uint64_t> buckets[HISTOGRAM_BUCKETS] ;
+};
+
+struct op_stats {
+    op_stats() : count(0), hits(0), misses(0), bytes(0) {
+        for ( auto &n : by_index ) { n.store(0, std::memory_order_relaxed) ; }
+    }
+    std::atomic<std::uint64_t> count ;
+    std::atomic<std::uint64_t> hits ;
+    std::atomic<std::uint64_t> misses ;
+    std::atomic<std::uint64_t> bytes ;
+    std::atomic<std::uint64_t> by_index[MAX_INDEXES] ;
+    log2_histogram lock_wait ;
+    log2_histogram lock_hold ;
+};
+
+/*
+ * Counters of one cache , constructed in the segment next to the container so a
+ * sidecar can map the segment and read them , see entity_cache::stats_of .
+ * Every process using the cache adds to the same counters with relaxed atomics.
+ */
+struct cache_stats {
+    cache_stats() : grow_events(0), grow_bytes(0),
+                    segment_size(0), min_free_memory(std::numeric_limits<std::uint64_t>::max()) {}
+
+    op_stats & operator[](cache_op op) {
+        return ops[static_cast<std::size_t>(op)] ;
+    }
+
+    void record(cache_op op, std::size_t index, bool hit, std::uint64_t bytes) {
+        op_stats &s = (*this)[op] ;
+        s.count.fetch_add(1, std::memory_order_relaxed) ;
+        (hit ? s.hits : s.misses).fetch_add(1, std::memory_order_relaxed) ;
+        s.by_index[index < MAX_INDEXES ? index : MAX_INDEXES - 1].fetch_add(1, std::memory_order_relaxed) ;
+        if ( bytes ) {
+            s.bytes.fetch_add(bytes, std::memory_order_relaxed) ;
+        }
+    }
+
+    void memory(std::uint64_t size, std::uint64_t free_memory) {
+        segment_size.store(size, std::memory_order_relaxed) ;
+        std::uint64_t low = min_free_memory.load(std::memory_order_relaxed) ;
+        while ( free_memory < low && !min_free_memory.compare_exchange_weak(low, free_memory, std::memory_order_relaxed) ) {}
+    }
+
+    void grown(std::uint64_t size) {
+        grow_events.fetch_add(1, std::memory_order_relaxed) ;
+        grow_bytes.fetch_add(size, std::memory_order_relaxed) ;
+    }
+
+    cache_stats_snapshot snapshot() const {
+        cache_stats_snapshot out {} ;
+        for ( std::size_t i = 0 ; i < CACHE_OP_COUNT ; ++i ) {
+            const op_stats &s = ops[i] ;
+            op_snapshot &o = out.ops[i] ;
+            o.count = s.count.load(std::memory_order_relaxed) ;
+            o.hits = s.hits.load(std::memory_order_relaxed) ;
+            o.misses = s.misses.load(std::memory_order_relaxed) ;
+            o.bytes = s.bytes.load(std::memory_order_relaxed) ;
+            for ( std::size_t j = 0 ; j < MAX_INDEXES ; ++j ) {
+                o.by_index[j] = s.by_index[j].load(std::memory_order_relaxed) ;
+            }
+            s.lock_wait.copy(o.lock_wait) ;
+            s.lock_hold.copy(o.lock_hold) ;
+        }
+        out.grow_events = grow_events.load(std::memory_order_relaxed) ;
+        out.grow_bytes = grow_bytes.load(std::memory_order_relaxed) ;
+        out.segment_size = segment_size.load(std::memory_order_relaxed) ;
+        out.min_free_memory = min_free_memory.load(std::memory_order_relaxed) ;
+        return out ;
+    }
+
+    op_stats ops[CACHE_OP_COUNT] ;
+    std::atomic<std::uint64_t> grow_events ;
+    std::atomic<std::uint64_t> grow_bytes ;
+    std::atomic<std::uint64_t> segment_size ;
+    std::atomic<std::uint64_t> min_free_memory ;
+};
+
+/*
+ * Wait and hold time of one lock acquisition , started right before the lock is
+ * requested , locked() right after it is granted , record() right before it is
+ * released. Nothing is recorded unless record() is called.
+ */
+class lock_timer {
+public:
+    lock_timer() : _start(std::chrono::steady_clock::now()), _locked(_start) {}
+    void locked() {
+        _locked = std::chrono::steady_clock::now() ;
+    }
+    void record(op_stats &s) const {
+        auto now = std::chrono::steady_clock::now() ;
+        s.lock_wait.record(std::chrono::duration_cast<std::chrono::nanoseconds>(_locked - _start).count()) ;
+        s.lock_hold.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - _locked).count()) ;
+    }
+private:
+    std::chrono::steady_clock::time_point _start ;
+    std::chrono::steady_clock::time_point _locked ;
+};
+
+}
+
+#endif /* __DATACACHE_CACHE_STATS_HPP__ */
@@ -0,0 +1,138 @@
+/*
+ * File:   change_log.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 17, 2026, 11:40 PM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __DATACACHE_CHANGE_LOG_HPP__
+#define __DATACACHE_CHANGE_LOG_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+namespace datacache {
+
+enum class change_op : std::int8_t {
+    insert = 1,
+    update = 2,
+    erase = 3,
+    clear = 4
+};
+
+enum class feed_status : std::int8_t {
+    changed = 0,
+    timeout = 1,
+    overrun = 2 // subscriber fell more than change_log::CAPACITY behind , re-read the whole cache
+};
+
+struct change_record {
+    std::uint64_t sequence ;
+    std::int64_t key ;
+    change_op op ;
+};
+
+/*
+ * Ring of the last CAPACITY changes , constructed in the cache segment.
+ * append is called by writers under the cache exclusive lock , subscribers read
+ * without any lock and validate every slot against its sequence.
+ * The condition only serves wakeups , it is notified once per write section.
+ */
+class change_log {
+public:
+    static const std::size_t CAPACITY = 4096 ;
+
+    change_log() : _head(0), _mutex(), _cond(), _ring() {}
+
+    std::uint64_t head() const {
+        return _head.load(std::memory_order_acquire) ;
+    }
+
+    void append(change_op op, std::int64_t key) {
+        std::uint64_t sequence = _head.load(std::memory_order_relaxed) + 1 ;
+        slot &s = _ring[sequence % CAPACITY] ;
+        s.sequence.store(0, std::memory_order_relaxed) ;
+        std::atomic_thread_fence(std::memory_order_release) ;
+        s.key = key ;
+        s.op = op ;
+        s.sequence.store(sequence, std::memory_order_release) ;
+        _head.store(sequence, std::memory_order_release) ;
+    }
+
+    void notify() {
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(_mutex) ;
+        _cond.notify_all() ;
+    }
+
+    /*
+     * Appends changes after cursor to out and moves cursor to the last one read.
+     * Waits up to timeout when there is nothing new.
+     */
+    feed_status read(std::uint64_t &cursor, std::vector<change_record> &out,
+                     const boost::posix_time::time_duration &timeout) {
+        if ( head() <= cursor ) {
+            boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + timeout ;
+            boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(_mutex) ;
+            while ( head() <= cursor ) {
+                if ( !_cond.timed_wait(lock, deadline) ) {
+                    return head() <= cursor ? feed_status::timeout : collect(cursor, out) ;
+                }
+            }
+        }
+        return collect(cursor, out) ;
+    }
+
+private:
+    struct slot {
+        slot() : sequence(0), key(), op() {}
+        std::atomic<std::uint64_t> sequence ;
+        std::int64_t key ;
+        change_op op ;
+    };
+
+    feed_status collect(std::uint64_t &cursor, std::vector<change_record> &out) const {
+        std::uint64_t last = head() ;
+        if ( last - cursor > CAPACITY ) {
+            cursor = last ;
+            return feed_status::overrun ;
+        }
+        for ( std::uint64_t sequence = cursor + 1 ; sequence <= last ; ++sequence ) {
+            const slot &s = _ring[sequence % CAPACITY] ;
+            change_record record { sequence, s.key, s.op } ;
+            std::atomic_thread_fence(std::memory_order_acquire) ;
+            if ( s.sequence.load(std::memory_order_acquire) != sequence ) {
+                cursor = head() ;
+                return feed_status::overrun ; // slot recycled while reading
+            }
+            out.push_back(record) ;
+        }
+        cursor = last ;
+        return feed_status::changed ;
+    }
+
+    std::atomic<std::uint64_t> _head ;
+    boost::interprocess::interprocess_mutex _mutex ;
+    boost::interprocess::interprocess_condition _cond ;
+    slot _ring[CAPACITY] ;
+};
+
+}
+
+#endif /* __DATACACHE_CHANGE_LOG_HPP__ */
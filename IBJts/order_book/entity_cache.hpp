@@ -20,7 +20,21 @@
 #ifndef __DATACACHE_ENTITY_CACHE_HPP__
 #define __DATACACHE_ENTITY_CACHE_HPP__
 
+#include "memory_types.hpp"
+#include "cache_stats.hpp"
+#include "change_log.hpp"
+#include "journal.hpp"
+#include "snapshot.hpp"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 #include <boost/interprocess/exceptions.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/containers/string.hpp>
@@ -28,6 +42,9 @@
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/interprocess/sync/sharable_lock.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/mpl/begin_end.hpp>
+#include <boost/mpl/distance.hpp>
+#include <boost/mpl/find.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
@@ -57,7 +74,43 @@ namespace {
 }
  
 namespace datacache {
-   
+
+/*
+ * Position of a paged walk over [lower, upper) of one ordered index ,
+ * see entity_cache::retrieve_page . anchor is the primary key of the last entry
+ * handed out , lower/upper may be partial composite keys (boost::make_tuple).
+ */
+template<typename Lower, typename Upper, typename Primary = long>
+struct range_cursor {
+    range_cursor(const Lower &l, const Upper &u) : lower(l), upper(u), anchor(), returned(), done(false) {}
+    Lower lower ;
+    Upper upper ;
+    Primary anchor ;
+    std::size_t returned ;
+    bool done ;
+};
+
+template<typename Lower, typename Upper>
+range_cursor<Lower, Upper> make_range_cursor(const Lower &lower, const Upper &upper) {
+    return range_cursor<Lower, Upper>(lower, upper) ;
+}
+
+/*
+ * Constructed in the segment next to the container.
+ * sequence is odd while a writer is inside the container and is bumped twice
+ * per write , checkpoints stamp their snapshot with it.
+ */
+struct cache_header {
+    cache_header() : sequence(0), generation(0) {}
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> generation; // bumped by whichever process grows the segment
+};
+
+/*
+ * Memory policy picks the segment and the lock , Shared and Mapped are shared by
+ * name between processes , Heap keeps the segment private to this instance and
+ * locks it with an in-process mutex , no named IPC object is created.
+ */
 template<typename Memory, template <class> class Container>
 class entity_cache
 {
@@ -66,69 +119,242 @@ public:
     using segment_manager_t = typename Memory::segment_manager_t ;
     using segment_t = typename Memory::segment_t ;
     using segment_ptr_t =  boost::scoped_ptr<segment_t>  ;
+    using mutex_t = typename Memory::mutex_t ;
     using char_allocator = boost::interprocess::allocator<char, segment_manager_t>  ;
     using char_string = boost::interprocess::basic_string<char, std::char_traits<char>, char_allocator>   ;
     using Container_t = Container<char_allocator> ;
     using Data_t = typename Container_t::value_type;
+    using key_maker_t = std::function<char_string(const std::string &)> ; // see retrieve_many_with
        
-entity_cache(const std::string &name) : _segment_ptr(), _container_ptr(), _store_name(), _cache_name(name),
-_named_mutex(bip::open_or_create, (_cache_name + "_mutex").c_str()) {
-//TODO: add to ctor to switch between mmap and shm
-std::string data_base_dir = "/tmp/CACHE" ;
-_store_name =  Memory::convert_base_dir(data_base_dir) + _cache_name;
-_segment_ptr.reset(new segment_t(bip::open_or_create, _store_name.c_str(), MEMORY_SIZE) ) ;
-_container_ptr = _segment_ptr->template find_or_construct<Container_t>( _cache_name.c_str() )
-    (typename Container_t::ctor_args_list() , typename Container_t::allocator_type(_segment_ptr->get_segment_manager()));
- 
+entity_cache(const std::string &name,
+             const mpclmi::ipc::growth_policy &growth = mpclmi::ipc::growth_policy()) :
+_segment_ptr(), _container_ptr(), _header_ptr(), _changes_ptr(), _stats_ptr(), _generation(), _changed(false), _journal_ptr(),
+_store_name(), _cache_name(name), _growth_policy(growth),
+_mutex(bip::open_or_create, (_cache_name + "_mutex").c_str()),
+_grow_mutex(), _grow_cv(), _grow_stop(false), _grower() {
+_store_name = store_name(_cache_name) ;
+_segment_ptr.reset(Memory::open_or_create_segment(_store_name, MEMORY_SIZE)) ;
+bind() ;
+if ( _growth_policy.background && Memory::named ) {
+    _grower = std::thread([this]() { grow_in_background(); }) ;
+}
 }
+    ~entity_cache() {
+        if ( _grower.joinable() ) {
+            {
+                std::lock_guard<std::mutex> lock(_grow_mutex) ;
+                _grow_stop = true ;
+            }
+            _grow_cv.notify_one() ;
+            _grower.join() ;
+        }
+    }
+    entity_cache(const entity_cache &) = delete ;
+    entity_cache & operator=(const entity_cache &) = delete ;
+
+    static std::string store_name(const std::string &name) {
+        //TODO: add to ctor to switch between mmap and shm
+        std::string data_base_dir = "/tmp/CACHE" ;
+        return Memory::convert_base_dir(data_base_dir) + name ;
+    }
+
+    /*
+     * Consistent point-in-time copy of a persistent (Mapped) segment into
+     * "<store>.snapshot" . Writers are held off only while the msync'ed image is
+     * copied , checksum and fsync happen after the lock is released.
+     */
+    bool checkpoint() {
+        if ( !Memory::persistent ) {
+            return false ;
+        }
+        snapshot::writer writer(_store_name + ".snapshot") ;
+        {
+            bip::sharable_lock<mutex_t> guard(_mutex);
+            remap_if_stale() ;
+            Memory::flush(*_segment_ptr) ;
+            if ( !writer.copy(_segment_ptr->get_address(), _segment_ptr->get_size(),
+                              _header_ptr->sequence.load(std::memory_order_acquire)) ) {
+                return false ;
+            }
+        }
+        return writer.commit() ;
+    }
+
+    /*
+     * Warm restart , must run before any process opens the cache.
+     * The backing file is replaced with the last valid snapshot , without one it is
+     * removed and the cache starts empty. Named mutex and change feed left behind by
+     * a crashed process are reset either way.
+     */
+    static bool recover(const std::string &name) {
+        if ( !Memory::persistent ) {
+            return false ;
+        }
+        std::string store = store_name(name) ;
+        bip::named_upgradable_mutex::remove((name + "_mutex").c_str()) ;
+        if ( !snapshot::restore(store + ".snapshot", store) ) {
+            LOG(info) << store << " no valid snapshot , cold start" ;
+            std::remove(store.c_str()) ;
+            return false ;
+        }
+        try {
+            std::unique_ptr<segment_t> segment(Memory::open_segment(store)) ;
+            segment->template destroy<change_log>((name + "_changes").c_str()) ;
+        } catch ( const bip::interprocess_exception &e ) {
+            LOG(info) << store << " snapshot can not be opened , cold start " << e.what() ;
+            std::remove(store.c_str()) ;
+            return false ;
+        }
+        LOG(info) << store << " restored from snapshot , warm start" ;
+        return true ;
+    }
+
     void clear() {
-        bip::scoped_lock<bip::named_upgradable_mutex> guard(_named_mutex) ;
+        write_guard guard(*this, cache_op::clear) ;
         _container_ptr->clear() ;
+        _changes_ptr->append(change_op::clear, 0) ;
+        _changed = true ;
+        if ( _journal_ptr ) {
+            _journal_ptr->append(change_op::clear, 0, nullptr, 0) ;
+        }
+        account(cache_op::clear, 0, true) ;
+    }
+
+    /*
+     * Counters shared by every process using the cache , see cache_stats.hpp .
+     * stats_of reads them by cache name without constructing an entity_cache ,
+     * for a sidecar , it is not available for Heap.
+     */
+    cache_stats_snapshot stats() const {
+        return _stats_ptr->snapshot() ;
+    }
+
+    static bool stats_of(const std::string &name, cache_stats_snapshot &out) {
+        try {
+            std::unique_ptr<segment_t> segment(Memory::open_segment(store_name(name))) ;
+            const cache_stats *stats = segment->template find<cache_stats>((name + "_stats").c_str()).first ;
+            if ( !stats ) {
+                return false ;
+            }
+            out = stats->snapshot() ;
+            return true ;
+        } catch ( const bip::interprocess_exception &e ) {
+            return false ;
+        }
+    }
+
+    /*
+     * Every mutation made through this instance is also appended to the journal ,
+     * durability is up to the journal group commit. Not owned , nullptr detaches.
+     * Writers go through journal::admit() before they take the lock , a journal that
+     * holds too much for a failing disk makes them throw before anything is changed.
+     */
+    void journal_to(journal *j) {
+        _journal_ptr = j ;
+    }
+
+    /*
+     * Change feed : subscribers take change_head() , read the cache once and then
+     * block in changes() for the keys inserted or updated after their cursor.
+     * feed_status::overrun means the subscriber fell behind the ring and has to
+     * re-read the whole cache , the cursor is already moved to the head.
+     */
+    std::uint64_t change_head() const {
+        return _changes_ptr->head() ;
+    }
+
+    feed_status changes(std::uint64_t &cursor, std::vector<change_record> &out,
+                        const boost::posix_time::time_duration &timeout) {
+        return _changes_ptr->read(cursor, out, timeout) ;
     }
    
     template<typename Tag, typename Serializable, typename Arg>
     bool update( const Serializable &data, Arg&& arg) {
-        bip::scoped_lock<bip::named_upgradable_mutex> guard(_named_mutex) ;
-        bool is_success {false};
-        auto &index = _container_ptr->template get<Tag>();
-        auto p = index.equal_range(std::forward<Arg>(arg));      
-        while ( p.first != p.second ) {
-            try {
-              is_success |= update_data(data,index,p.first++);
-            } catch (const bad_alloc_exception_t &e) {
-              LOG(debug) << boost::core::demangle(typeid(*this).name())
-              << " data was not updated , MEMORY AVAILABLE="
-              <<  _segment_ptr->get_free_memory() ;
-              grow_memory(MEMORY_SIZE);
-              is_success |= update_data(data,index,p.first++);
-            }
-        }
+        write_guard guard(*this, cache_op::update) ;
+        bool is_success = apply_range<Tag>(std::forward<Arg>(arg), [&](Index_t<Tag> &index, Iterator_t<Tag> itr) {
+            return update_data(data, index, itr) ;
+        }) ;
+        grow_ahead();
+        account(cache_op::update, index_of<Tag>(), is_success) ;
         return is_success;
     }
  
     template<typename Tag, typename Serializable, typename ...Args>
     bool update( const Serializable &data, Args&& ...args) {
-        bip::scoped_lock<bip::named_upgradable_mutex> guard(_named_mutex) ;
-        bool is_success {false};
+        write_guard guard(*this, cache_op::update) ;
+        bool is_success = apply_range<Tag>(boost::make_tuple(std::forward<Args>(args)...), [&](Index_t<Tag> &index, Iterator_t<Tag> itr) {
+            return update_data(data, index, itr) ;
+        }) ;
+        grow_ahead();
+        account(cache_op::update, index_of<Tag>(), is_success) ;
+        return is_success;
+    }
+ 
+    /*
+     * In-place partial update , fn(Data_t &) patches the in-segment entity of every
+     * match under the exclusive lock , no decode/encode round trip of a Serializable.
+     * If fn runs out of segment memory it is called again on the same entity after
+     * the grow , so it has to be restartable .
+     */
+    template<typename Tag, typename Arg, typename Fn>
+    bool modify(Arg && arg, Fn && fn) {
+        write_guard guard(*this, cache_op::modify) ;
+        bool is_success = apply_range<Tag>(std::forward<Arg>(arg), [&](Index_t<Tag> &index, Iterator_t<Tag> itr) {
+            return modify_data(index, itr, fn) ;
+        }) ;
+        grow_ahead();
+        account(cache_op::modify, index_of<Tag>(), is_success) ;
+        return is_success;
+    }
+ 
+    /*
+     * Several modifies under one exclusive section , fn(Data_t &, const Value &) runs on
+     * every match of each key in the order given , same restart rule as modify.
+     * Returns number of keys that matched.
+     */
+    template<typename Tag, typename Key, typename Value, typename Fn>
+    std::size_t modify_batch(const std::vector<std::pair<Key, Value>> &items, Fn && fn) {
+        write_guard guard(*this, cache_op::modify) ;
+        std::size_t n {} ;
+        for ( const auto &item : items ) {
+            auto patch = [&fn, &item](Data_t &entity) { fn(entity, item.second) ; } ;
+            bool is_success = apply_range<Tag>(item.first, [&](Index_t<Tag> &index, Iterator_t<Tag> itr) {
+                return modify_data(index, itr, patch) ;
+            }) ;
+            account(cache_op::modify, index_of<Tag>(), is_success) ;
+            n += is_success ;
+        }
+        grow_ahead();
+        return n ;
+    }
+
+    /*
+     * Erases every match for which pred(const Data_t &) is true , freed blocks go
+     * back to the segment manager and are reused by later inserts.
+     * Returns number of erased entries.
+     */
+    template<typename Tag, typename Arg, typename Pred>
+    std::size_t erase_if(Arg && arg, Pred && pred) {
+        write_guard guard(*this, cache_op::erase) ;
+        std::size_t n {} ;
         auto &index = _container_ptr->template get<Tag>();
-        auto p = index.equal_range(boost::make_tuple(std::forward<Args>(args)...));
-         while ( p.first != p.second ) {
-            try {
-              is_success |= update_data(data,index,p.first++);
-            } catch (const bad_alloc_exception_t &e) {
-              LOG(debug) << boost::core::demangle(typeid(*this).name())
-              << " data was not updated , MEMORY AVAILABLE="
-              <<  _segment_ptr->get_free_memory() ;
-              grow_memory(MEMORY_SIZE);
-              is_success |= update_data(data,index,p.first++);
+        auto p = index.equal_range(std::forward<Arg>(arg));
+        while ( p.first != p.second ) {
+            if ( pred(static_cast<const Data_t &>(*p.first)) ) {
+                record_change(change_op::erase, *p.first) ;
+                p.first = index.erase(p.first) ;
+                ++n ;
+            } else {
+                ++p.first ;
             }
         }
-        return is_success;
+        account(cache_op::erase, index_of<Tag>(), n) ;
+        return n ;
     }
- 
+
     template<typename Serializable>
     bool insert( const Serializable &data) {
-        bip::scoped_lock<bip::named_upgradable_mutex> guard(_named_mutex) ;
+        write_guard guard(*this, cache_op::insert) ;
         bool is_success {false};
         try {
             is_success = insert_data(data);
@@ -136,73 +362,262 @@ _container_ptr = _segment_ptr->template find_or_construct<Container_t>( _cache_n
             LOG(debug) << boost::core::demangle(typeid(*this).name())
             << " data was not inserted , MEMORY AVAILABLE="
             <<  _segment_ptr->get_free_memory(); 
-            grow_memory(MEMORY_SIZE);
+            grow_memory(growth_increment());
             is_success = insert_data(data);
         }
- 
+        grow_ahead();
+        account(cache_op::insert, 0, is_success) ;
         return is_success;
     }
    
+    /*
+     * Bulk load : one lock and at most one grow for the whole batch,
+     * the segment is pre-sized with Data_t::size before anything is inserted.
+     */
     template<typename Serializable>
     bool insert( const std::vector<Serializable> &data) {
-        bip::scoped_lock<bip::named_upgradable_mutex> guard(_named_mutex) ;
-        bool is_success {false};
+        write_guard guard(*this, cache_op::insert) ;
+        reserve_memory(batch_size(data));
         std::size_t n {data.size()} ;
         for ( const auto &item : data) {
             try {
-                if ( insert_data(data) ) { --n; }
+                if ( emplace_data(item) ) { --n; }
             } catch (const bad_alloc_exception_t &e) {
                 LOG(debug) << boost::core::demangle(typeid(*this).name())
                 << " data was not inserted , MEMORY AVAILABLE="
                 <<  _segment_ptr->get_free_memory(); 
-                grow_memory(MEMORY_SIZE);
-                if ( insert_data(data) ) { --n; }
+                grow_memory(growth_increment());
+                if ( emplace_data(item) ) { --n; }
             }
         }
+        grow_ahead();
+        account(cache_op::insert, 0, !n) ;
         return !n;
     }
        
     template<typename Tag, typename Serializable, typename Arg>
     bool retrieve(std::vector<std::shared_ptr<Serializable>> &entries, Arg && arg) {
-        bip::sharable_lock<bip::named_upgradable_mutex> guard(_named_mutex);
-        bool is_found = false;
-        auto p = _container_ptr->template get<Tag>().equal_range(std::forward<Arg>(arg));
-        std::transform ( p.first, p.second, std::back_inserter(entries), [] ( const Data_t &data ) {
-            std::shared_ptr<Serializable> impl_ptr { std::make_shared<Serializable>() } ;
-            data.retrieve(*impl_ptr) ;
-            return impl_ptr;
+        std::size_t n {entries.size()} ;
+        read_section(cache_op::retrieve, [&]() {
+            entries.resize(n) ;
+            auto p = _container_ptr->template get<Tag>().equal_range(std::forward<Arg>(arg));
+            std::transform ( p.first, p.second, std::back_inserter(entries), [this] ( const Data_t &data ) {
+                return decode<Serializable>(data) ;
+            });
         });
+        account(cache_op::retrieve, index_of<Tag>(), entries.size() > n) ;
         return !entries.empty();
     }
       
     template<typename Tag, typename Serializable, typename ...Args>
     bool retrieve(std::vector<std::shared_ptr<Serializable>> &entries, Args&& ...args) {
-        bip::sharable_lock<bip::named_upgradable_mutex> guard(_named_mutex);
-        bool is_found = false;
-        auto p = _container_ptr->template get<Tag>().equal_range(boost::make_tuple(std::forward<Args>(args)...));
-        std::transform ( p.first, p.second, std::back_inserter(entries), [] ( const Data_t &data ) {
-            std::shared_ptr<Serializable> impl_ptr { std::make_shared<Serializable>() } ;
-            data.retrieve(*impl_ptr) ;
-            return impl_ptr;
+        std::size_t n {entries.size()} ;
+        read_section(cache_op::retrieve, [&]() {
+            entries.resize(n) ;
+            auto p = _container_ptr->template get<Tag>().equal_range(boost::make_tuple(std::forward<Args>(args)...));
+            std::transform ( p.first, p.second, std::back_inserter(entries), [this] ( const Data_t &data ) {
+                return decode<Serializable>(data) ;
+            });
         });
+        account(cache_op::retrieve, index_of<Tag>(), entries.size() > n) ;
         return !entries.empty();
     }
  
  
     template<typename Serializable>
     bool retrieve(std::vector<std::shared_ptr<Serializable>> &entries) {
-        bip::sharable_lock<bip::named_upgradable_mutex> guard(_named_mutex);
-        bool is_found = false;
-        auto p = std::make_pair(_container_ptr->begin(), _container_ptr->end());
-        std::transform ( p.first, p.second, std::back_inserter(entries), [] ( const Data_t &data ) {
-            std::shared_ptr<Serializable> impl_ptr { std::make_shared<Serializable>() } ;
-            data.retrieve(*impl_ptr) ;
-            return impl_ptr;
+        std::size_t n {entries.size()} ;
+        read_section(cache_op::retrieve, [&]() {
+            entries.resize(n) ;
+            auto p = std::make_pair(_container_ptr->begin(), _container_ptr->end());
+            std::transform ( p.first, p.second, std::back_inserter(entries), [this] ( const Data_t &data ) {
+                return decode<Serializable>(data) ;
+            });
         });
+        account(cache_op::retrieve, 0, entries.size() > n) ;
         return !entries.empty();
     }
   
+    /*
+     * Batch lookup , all keys are looked up under one read section instead of one
+     * lock per key. Keys are sorted and de-duplicated first so the index is walked in
+     * order , matches are appended in key order. Returns number of entries appended.
+     */
+    template<typename Tag, typename Serializable, typename Key>
+    std::size_t retrieve_many(std::vector<std::shared_ptr<Serializable>> &entries, std::vector<Key> keys) {
+        std::size_t n {entries.size()} ;
+        read_section(cache_op::retrieve, [&]() {
+            entries.resize(n) ;
+            collect<Tag>(entries, keys) ;
+        });
+        account(cache_op::retrieve, index_of<Tag>(), entries.size() > n) ;
+        return entries.size() - n ;
+    }
+
+    /*
+     * retrieve_many for keys holding strings , which have to live in the segment.
+     * make_keys(key) builds the keys , key(string) allocates one string in the segment.
+     * The strings are allocated , looked up and freed in one exclusive section , so
+     * they never race a grow , a remap of this process or a checkpoint image.
+     */
+    template<typename Tag, typename Serializable, typename MakeKeys>
+    std::size_t retrieve_many_with(std::vector<std::shared_ptr<Serializable>> &entries, MakeKeys &&make_keys) {
+        std::size_t n {entries.size()} ;
+        {
+            write_guard guard(*this, cache_op::retrieve) ;
+            auto keys = make_keys(key_maker_t([this](const std::string &key) { return allocate_key(key) ; })) ;
+            collect<Tag>(entries, keys) ;
+        }
+        account(cache_op::retrieve, index_of<Tag>(), entries.size() > n) ;
+        return entries.size() - n ;
+    }
+
+    /*
+     * Entries with lower <= key < upper on Tag in index order , at most limit of them.
+     * Returns number of entries appended.
+     */
+    template<typename Tag, typename Serializable, typename Lower, typename Upper>
+    std::size_t retrieve_range(std::vector<std::shared_ptr<Serializable>> &entries, const Lower &lower,
+                               const Upper &upper, std::size_t limit = std::numeric_limits<std::size_t>::max()) {
+        std::size_t n {entries.size()} ;
+        read_section(cache_op::retrieve, [&]() {
+            entries.resize(n) ;
+            auto &index = _container_ptr->template get<Tag>();
+            auto itr = index.lower_bound(lower) ;
+            for ( std::size_t taken = 0 ; taken < limit && in_range(index, itr, upper) ; ++itr, ++taken ) {
+                entries.push_back(decode<Serializable>(*itr)) ;
+            }
+        });
+        account(cache_op::retrieve, index_of<Tag>(), entries.size() > n) ;
+        return entries.size() - n ;
+    }
+
+    /*
+     * Next page of at most limit entries of a range_cursor walk , the lock is held
+     * for one page only so writers get in between pages.
+     * On the primary index the walk resumes after the anchor key and is exact.
+     * On a secondary index it resumes right after the anchor entry , an entry whose
+     * Tag key changes between pages may be seen twice or missed , the same as with any
+     * pagination that is not a snapshot. If the anchor was erased or left the range the
+     * walk skips the number of entries already handed out from the start of the range.
+     * Returns number of entries appended , 0 and cursor.done once the range is exhausted.
+     */
+    template<typename Tag, typename Serializable, typename Lower, typename Upper, typename Primary>
+    std::size_t retrieve_page(std::vector<std::shared_ptr<Serializable>> &entries,
+                              range_cursor<Lower, Upper, Primary> &cursor, std::size_t limit) {
+        if ( cursor.done ) {
+            return 0 ;
+        }
+        std::size_t n {entries.size()} ;
+        Primary anchor {cursor.anchor} ;
+        bool done {true} ;
+        read_section(cache_op::retrieve, [&]() {
+            entries.resize(n) ;
+            anchor = cursor.anchor ;
+            done = true ;
+            auto &index = _container_ptr->template get<Tag>();
+            for ( auto itr = resume<Tag>(cursor) ; in_range(index, itr, cursor.upper) ; ++itr ) {
+                if ( entries.size() - n == limit ) {
+                    done = false ;
+                    break ;
+                }
+                entries.push_back(decode<Serializable>(*itr)) ;
+                anchor = Data_t::primary_key(*itr) ;
+            }
+        });
+        cursor.anchor = anchor ;
+        cursor.returned += entries.size() - n ;
+        cursor.done = done ;
+        account(cache_op::retrieve, index_of<Tag>(), entries.size() > n) ;
+        return entries.size() - n ;
+    }
+
+    /*
+     * Zero-copy access , fn is called with const Data_t& of every match while the
+     * sharable lock is held, keys and raw blob are read in place from the segment.
+     * Call data.retrieve(obj) from inside fn only if the decoded object is needed.
+     * fn must not call back into this cache . Returns number of visited entries.
+     */
+    template<typename Tag, typename Arg, typename Fn>
+    std::size_t visit(Arg && arg, Fn && fn) {
+        std::size_t n {} ;
+        {
+            lock_timer timer ;
+            bip::sharable_lock<mutex_t> guard(_mutex);
+            timer.locked() ;
+            remap_if_stale() ;
+            auto p = _container_ptr->template get<Tag>().equal_range(std::forward<Arg>(arg));
+            for ( ; p.first != p.second ; ++p.first, ++n ) {
+                fn(static_cast<const Data_t &>(*p.first)) ;
+            }
+            timer.record((*_stats_ptr)[cache_op::visit]) ;
+        }
+        account(cache_op::visit, index_of<Tag>(), n) ;
+        return n;
+    }
+
+    template<typename Fn>
+    std::size_t visit(Fn && fn) {
+        std::size_t n {} ;
+        {
+            lock_timer timer ;
+            bip::sharable_lock<mutex_t> guard(_mutex);
+            timer.locked() ;
+            remap_if_stale() ;
+            for ( const Data_t &data : *_container_ptr ) {
+                fn(data) ;
+                ++n ;
+            }
+            timer.record((*_stats_ptr)[cache_op::visit]) ;
+        }
+        account(cache_op::visit, 0, n) ;
+        return n;
+    }
+
+    /*
+     * Chunked scan , fn(const Serializable &) runs on every match with no lock held.
+     * The sharable lock is taken once per SCAN_CHUNK entries , so a writer waits for
+     * one chunk at most however long the scan is. It is not a snapshot , every entity
+     * is decoded from a whole copy of its blob but each chunk reflects the cache as of when it was collected , the
+     * same as retrieve_page : an entry whose Tag key changes between chunks may be
+     * seen twice or missed. When the last entry of a chunk is erased the walk resumes
+     * after its key on an ordered primary index , anywhere else it skips the entries
+     * already handed out and misses as many as were erased before that point. On a
+     * hashed index an insert that rehashes between chunks may reorder the rest.
+     * Returns number of entries scanned.
+     */
+    template<typename Tag, typename Serializable, typename Arg, typename Fn>
+    std::size_t scan(Arg && arg, Fn && fn) {
+        return scan_range<Tag, Serializable>([&](Index_t<Tag> &index) {
+            return index.equal_range(arg).first ;
+        }, [&](const Index_t<Tag> &index, const Data_t &entity) {
+            return matches(index, entity, arg, 0) ;
+        }, fn) ;
+    }
+
+    template<typename Serializable, typename Fn>
+    std::size_t scan(Fn && fn) {
+        using primary_tag = typename Data_t::primary_tag ;
+        return scan_range<primary_tag, Serializable>([](Index_t<primary_tag> &index) {
+            return index.begin() ;
+        }, [](const Index_t<primary_tag> &, const Data_t &) {
+            return true ;
+        }, fn) ;
+    }
+
+    /*
+     * Key string allocated in the segment under the exclusive lock. It points into the
+     * mapping of the moment , an operation that remaps this process (another one grew
+     * the segment) leaves it dangling , lookups with such keys use retrieve_many_with .
+     */
    char_string create_ipc_key(const std::string &key)  const {
+       bip::scoped_lock<mutex_t> guard(_mutex) ;
+       remap_if_stale() ;
+       return allocate_key(key) ;
+   }
+private:
+    // exclusive lock held
+    char_string allocate_key(const std::string &key) const {
        try {
            char_string tmp(key.data(), key.size(), _segment_ptr->get_segment_manager()) ;
            return tmp;
@@ -210,51 +625,487 @@ _container_ptr = _segment_ptr->template find_or_construct<Container_t>( _cache_n
            LOG(debug) << boost::core::demangle(typeid(*this).name())
            << " create_ipc_key failed , MEMORY AVAILABLE="
            <<  _segment_ptr->get_free_memory(); 
-           grow_memory(MEMORY_SIZE) ;
+           grow_memory(growth_increment()) ;
            char_string tmp(key.data(), key.size(), _segment_ptr->get_segment_manager()) ;
            return tmp;
        }
-   }
-private:
+    }
+
+    // matches of keys on Tag , sorted and de-duplicated first , in a read or write section
+    template<typename Tag, typename Serializable, typename Key>
+    void collect(std::vector<std::shared_ptr<Serializable>> &entries, std::vector<Key> &keys) const {
+        std::sort(keys.begin(), keys.end()) ;
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end()) ;
+        auto &index = _container_ptr->template get<Tag>();
+        for ( const auto &key : keys ) {
+            auto p = index.equal_range(key) ;
+            for ( ; p.first != p.second ; ++p.first ) {
+                entries.push_back(decode<Serializable>(*p.first)) ;
+            }
+        }
+    }
+
+    /*
+     * Exclusive section for writers , holds the named mutex and keeps
+     * cache_header::sequence odd for the whole duration of the write.
+     * The header is re-read on exit because grow_memory re-attaches.
+     * Iterators and index references must not be kept across grow_memory .
+     */
+    class write_guard {
+    public:
+        write_guard(entity_cache &cache, cache_op op) : _timer(), _lock(admit(cache, op)), _cache(cache), _op(op) {
+            _timer.locked() ;
+            _cache.remap_if_stale() ;
+            auto &sequence = _cache._header_ptr->sequence ;
+            sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed) ;
+            std::atomic_thread_fence(std::memory_order_release) ;
+        }
+        ~write_guard() {
+            _timer.record((*_cache._stats_ptr)[_op]) ;
+            _cache._header_ptr->sequence.fetch_add(1, std::memory_order_release) ;
+            if ( _cache._changed ) {
+                _cache._changed = false ;
+                _cache._changes_ptr->notify() ;
+            }
+        }
+        write_guard(const write_guard &) = delete ;
+        write_guard & operator=(const write_guard &) = delete ;
+    private:
+        // a mutation waits for , or is refused by , the journal before the lock is taken
+        static mutex_t & admit(entity_cache &cache, cache_op op) {
+            if ( cache._journal_ptr && op != cache_op::retrieve ) {
+                cache._journal_ptr->admit() ;
+            }
+            return cache._mutex ;
+        }
+        lock_timer _timer ; // started before the lock is requested
+        bip::scoped_lock<mutex_t> _lock ;
+        entity_cache &_cache ;
+        cache_op _op ;
+    };
+
+    // every retrieve , under the sharable lock with the time spent waiting for it recorded
+    template<typename Read>
+    void read_section(cache_op op, Read &&read) {
+        lock_timer timer ;
+        bip::sharable_lock<mutex_t> guard(_mutex);
+        timer.locked() ;
+        remap_if_stale() ;
+        op_bytes() = 0 ;
+        read() ;
+        timer.record((*_stats_ptr)[op]) ;
+    }
+
+    // position of Tag in the container indexes , for per index counters
+    template<typename Tag>
+    static constexpr std::size_t index_of() {
+        return boost::mpl::distance<typename boost::mpl::begin<typename Container_t::index_type_list>::type,
+                                    typename boost::mpl::find<typename Container_t::index_type_list, Index_t<Tag>>::type>::value ;
+    }
+
+    // blob bytes of the operation in progress on this thread , readers run concurrently
+    static std::uint64_t & op_bytes() {
+        static thread_local std::uint64_t bytes {} ;
+        return bytes ;
+    }
+
+    void account(cache_op op, std::size_t index, bool hit) const {
+        _stats_ptr->record(op, index, hit, op_bytes()) ;
+        op_bytes() = 0 ;
+    }
+
+    /*
+     * Segment only moves when somebody grows it , so instead of re-opening it
+     * on every operation compare the generation in the header with the one this
+     * process has mapped. The old mapping stays valid for the header because
+     * grow only ever extends the segment. Called with the named mutex held.
+     */
+    bool is_stale() const {
+        return _header_ptr->generation.load(std::memory_order_acquire) != _generation ;
+    }
+
+    void remap_if_stale() const {
+        if ( is_stale() ) {
+            attach() ;
+        }
+    }
+
     void attach() const {
-    _segment_ptr.reset(new segment_t(bip::open_only,_store_name.c_str()) ) ;
+    Memory::remap(_segment_ptr, _store_name) ;
+    bind() ;
+    }
+
+    // refresh pointers into the segment , its base address changes on remap and on Heap grow
+    void bind() const {
     _container_ptr = _segment_ptr->template find_or_construct<Container_t>(_cache_name.c_str())
         (typename Container_t::ctor_args_list(), typename Container_t::allocator_type(_segment_ptr->get_segment_manager()));
+    _header_ptr = _segment_ptr->template find_or_construct<cache_header>((_cache_name + "_header").c_str())() ;
+    _changes_ptr = _segment_ptr->template find_or_construct<change_log>((_cache_name + "_changes").c_str())() ;
+    _stats_ptr = _segment_ptr->template find_or_construct<cache_stats>((_cache_name + "_stats").c_str())() ;
+    _generation = _header_ptr->generation.load(std::memory_order_acquire) ;
     }
  
     void grow_memory(size_t size) const {
         try {
-          _segment_ptr.reset() ;
-          segment_t::grow(_store_name.c_str(), size) ;
+          Memory::grow(_segment_ptr, _store_name, size) ;
+          bind() ;
+          _stats_ptr->grown(size) ;
         } catch ( const  bad_alloc_exception_t &e ) {
             LOG(debug) << boost::core::demangle(typeid(*this).name())       
-            << " failed to grow " << e.what() << ":free mem=" << _segment_ptr->get_free_memory() ;
+            << " failed to grow " << e.what() ;
+            attach() ; // reattach to the segment as it was
+        }
+        _generation = _header_ptr->generation.fetch_add(1, std::memory_order_acq_rel) + 1 ;
+    }
+
+    std::size_t growth_increment() const {
+        return _growth_policy.increment(_segment_ptr->get_size()) ;
+    }
+
+    /*
+     * Called by writers at the end of the exclusive section, grows before the next
+     * bad_alloc rather than in the middle of an insert. With background growth
+     * the writer only wakes up the grower thread.
+     */
+    void grow_ahead() const {
+        _stats_ptr->memory(_segment_ptr->get_size(), _segment_ptr->get_free_memory()) ;
+        if ( !_growth_policy.below_watermark(_segment_ptr->get_free_memory(), _segment_ptr->get_size()) ) {
+            return ;
+        }
+        if ( _grower.joinable() ) {
+            _grow_cv.notify_one() ;
+        } else {
+            grow_memory(growth_increment()) ;
+        }
+    }
+
+    /*
+     * Grower thread , also wakes up periodically to catch segments filled by other processes.
+     * It works on its own mapping and never touches _segment_ptr , this and
+     * other processes remap on their next operation through the generation.
+     */
+    void grow_in_background() {
+        std::unique_lock<std::mutex> lock(_grow_mutex) ;
+        while ( !_grow_stop ) {
+            _grow_cv.wait_for(lock, std::chrono::seconds(1)) ;
+            if ( _grow_stop ) {
+                break ;
+            }
+            lock.unlock() ;
+            grow_by_name(std::integral_constant<bool, Memory::named>()) ;
+            lock.lock() ;
+        }
+    }
+
+    void grow_by_name(std::true_type) {
+        try {
+            bip::scoped_lock<mutex_t> guard(_mutex) ;
+            std::unique_ptr<segment_t> segment(Memory::open_segment(_store_name)) ; // HugePage may have moved it
+            std::size_t size = segment->get_size() ;
+            cache_header *header = segment->template find<cache_header>((_cache_name + "_header").c_str()).first ;
+            cache_stats *stats = segment->template find<cache_stats>((_cache_name + "_stats").c_str()).first ;
+            if ( header && _growth_policy.below_watermark(segment->get_free_memory(), size) ) {
+                std::size_t increment = _growth_policy.increment(size) ;
+                Memory::grow(_store_name, increment) ;
+                header->generation.fetch_add(1, std::memory_order_acq_rel) ;
+                if ( stats ) {
+                    stats->grown(increment) ;
+                }
+                LOG(debug) << boost::core::demangle(typeid(*this).name()) << " grown ahead , previous size=" << size ;
+            }
+        } catch ( const bip::interprocess_exception &e ) {
+            LOG(debug) << boost::core::demangle(typeid(*this).name()) << " failed to grow " << e.what() ;
+        }
+    }
+
+    void grow_by_name(std::false_type) {} // Heap is never started with a grower
+ 
+    template<typename Serializable>
+    static std::size_t batch_size(const std::vector<Serializable> &data) {
+        std::size_t size {} ;
+        for ( const auto &item : data) {
+            size += Data_t::size(item) + ENTRY_OVERHEAD ;
+        }
+        return size;
+    }
+
+    void reserve_memory(std::size_t size) const {
+        std::size_t free_memory = _segment_ptr->get_free_memory() ;
+        if ( free_memory < size ) {
+            grow_memory(std::max<std::size_t>(size - free_memory, growth_increment())) ;
         }
-        attach() ; // reattach to newly created
     }
  
     template<typename Serializable>
     bool insert_data(const  Serializable &data) {
-        attach();
+        return emplace_data(data);
+    }
+
+    template<typename Serializable>
+    bool emplace_data(const  Serializable &data) {
         Data_t item(_segment_ptr->get_segment_manager());
         item.store(data);
-        return _container_ptr->insert(item).second;
+        auto p = _container_ptr->insert(item);
+        if ( p.second ) {
+            record_change(change_op::insert, *p.first) ;
+        }
+        return p.second;
+    }
+
+    void record_change(change_op op, const Data_t &entity) const {
+        std::int64_t key = static_cast<std::int64_t>(Data_t::primary_key(entity)) ;
+        _changes_ptr->append(op, key) ;
+        _changed = true ;
+        op_bytes() += entity.blob.size() ;
+        if ( _journal_ptr && op == change_op::erase ) {
+            _journal_ptr->append(op, key, nullptr, 0) ;
+        } else if ( _journal_ptr ) {
+            _journal_ptr->append(op, key, entity.blob.data(), entity.blob.size()) ;
+        }
+    }
+
+    /*
+     * Blobs of a chunk are copied under a short sharable lock and decoded after it
+     * is released , then the next chunk resumes after the last entry like
+     * retrieve_page does. first(index) is where the range starts ,
+     * member(index, entity) whether an entry still belongs to it , the walk stops at
+     * the first one that does not.
+     */
+    template<typename Tag, typename Serializable, typename First, typename Member, typename Fn>
+    std::size_t scan_range(First first, Member member, Fn &fn) {
+        using primary_tag = typename Data_t::primary_tag ;
+        using primary_t = typename std::decay<decltype(Data_t::primary_key(std::declval<const Data_t &>()))>::type ;
+        std::vector<std::size_t> ends ; // of each blob in copies
+        std::vector<char> copies ;
+        primary_t anchor {} ;
+        std::size_t returned {} ;
+        std::uint64_t bytes {} ;
+        bool more {true} ;
+        while ( more ) {
+            ends.clear() ;
+            copies.clear() ;
+            {
+                lock_timer timer ;
+                bip::sharable_lock<mutex_t> guard(_mutex);
+                timer.locked() ;
+                remap_if_stale() ;
+                auto &index = _container_ptr->template get<Tag>() ;
+                auto itr = first(index) ;
+                bool resumed {false} ;
+                if ( returned ) {
+                    auto &primary = _container_ptr->template get<primary_tag>() ;
+                    auto found = primary.find(anchor) ;
+                    if ( found != primary.end() ) {
+                        auto at = _container_ptr->template project<Tag>(found) ;
+                        if ( member(index, *at) ) {
+                            itr = ++at ;
+                            resumed = true ;
+                        }
+                    }
+                    if ( !resumed ) {
+                        itr = skip_after(std::is_same<Tag, primary_tag>(), index, itr, anchor, returned) ;
+                    }
+                }
+                for ( ; itr != index.end() && member(index, *itr) && ends.size() < SCAN_CHUNK ; ++itr ) {
+                    const Data_t &entity = *itr ;
+                    copies.insert(copies.end(), entity.blob.begin(), entity.blob.end()) ;
+                    ends.push_back(copies.size()) ;
+                    anchor = Data_t::primary_key(entity) ;
+                }
+                more = itr != index.end() && member(index, *itr) ;
+                timer.record((*_stats_ptr)[cache_op::scan]) ;
+            }
+            std::size_t begin {} ;
+            for ( std::size_t end : ends ) {
+                Serializable data ;
+                Data_t::load(copies.data() + begin, end - begin, data) ;
+                begin = end ;
+                fn(static_cast<const Serializable &>(data)) ;
+            }
+            bytes += copies.size() ;
+            returned += ends.size() ;
+        }
+        op_bytes() = bytes ;
+        account(cache_op::scan, index_of<Tag>(), returned) ;
+        return returned ;
+    }
+
+    // the anchor of a scan was erased or left the range , skip what was handed out
+    template<typename Index, typename Key>
+    static typename Index::iterator skip_after(std::false_type, Index &index, typename Index::iterator itr,
+                                               const Key &, std::size_t returned) {
+        for ( std::size_t skipped = 0 ; skipped < returned && itr != index.end() ; ++skipped ) {
+            ++itr ;
+        }
+        return itr ;
+    }
+
+    // on the primary index the erased anchor key is still a position , when it is ordered
+    template<typename Index, typename Key>
+    static typename Index::iterator skip_after(std::true_type, Index &index, typename Index::iterator itr,
+                                               const Key &anchor, std::size_t returned) {
+        return after_key(index, itr, anchor, returned, 0) ;
+    }
+
+    template<typename Index, typename Key>
+    static auto after_key(Index &index, typename Index::iterator, const Key &anchor, std::size_t, int)
+        -> decltype(index.upper_bound(anchor)) {
+        return index.upper_bound(anchor) ;
+    }
+
+    template<typename Index, typename Key>
+    static typename Index::iterator after_key(Index &index, typename Index::iterator itr, const Key &anchor, std::size_t returned, long) {
+        return skip_after(std::false_type(), index, itr, anchor, returned) ;
+    }
+
+    // entity is in the equal_range of arg on an ordered index
+    template<typename Index, typename Arg>
+    static auto matches(const Index &index, const Data_t &entity, const Arg &arg, int)
+        -> decltype(index.key_comp(), bool()) {
+        auto key = index.key_extractor()(entity) ;
+        return !index.key_comp()(key, arg) && !index.key_comp()(arg, key) ;
+    }
+
+    // and on a hashed one
+    template<typename Index, typename Arg>
+    static bool matches(const Index &index, const Data_t &entity, const Arg &arg, long) {
+        return index.key_eq()(index.key_extractor()(entity), arg) ;
+    }
+
+    template<typename Tag>
+    using Index_t = typename Container_t::template index<Tag>::type ;
+    template<typename Tag>
+    using Iterator_t = typename Index_t<Tag>::iterator ;
+
+    template<typename Serializable>
+    std::shared_ptr<Serializable> decode(const Data_t &data) const {
+        std::shared_ptr<Serializable> impl_ptr { std::make_shared<Serializable>() } ;
+        data.retrieve(*impl_ptr) ;
+        op_bytes() += data.blob.size() ;
+        return impl_ptr ;
+    }
+
+    template<typename Index, typename Iterator, typename Upper>
+    static bool in_range(const Index &index, const Iterator &itr, const Upper &upper) {
+        return itr != index.end() && index.key_comp()(index.key_extractor()(*itr), upper) ;
+    }
+
+    template<typename Tag, typename Lower, typename Upper, typename Primary>
+    Iterator_t<Tag> resume(const range_cursor<Lower, Upper, Primary> &cursor) {
+        auto &index = _container_ptr->template get<Tag>();
+        if ( !cursor.returned ) {
+            return index.lower_bound(cursor.lower) ;
+        }
+        using primary_tag = typename Data_t::primary_tag ;
+        return resume_after<Tag>(std::is_same<Tag, primary_tag>(), cursor) ;
+    }
+
+    // walk over the primary index , the anchor itself is the key to resume after
+    template<typename Tag, typename Lower, typename Upper, typename Primary>
+    Iterator_t<Tag> resume_after(std::true_type, const range_cursor<Lower, Upper, Primary> &cursor) {
+        return _container_ptr->template get<Tag>().upper_bound(cursor.anchor) ;
+    }
+
+    template<typename Tag, typename Lower, typename Upper, typename Primary>
+    Iterator_t<Tag> resume_after(std::false_type, const range_cursor<Lower, Upper, Primary> &cursor) {
+        using primary_tag = typename Data_t::primary_tag ;
+        auto &index = _container_ptr->template get<Tag>();
+        auto &primary = _container_ptr->template get<primary_tag>();
+        auto anchor = primary.find(cursor.anchor) ;
+        if ( anchor != primary.end() ) {
+            auto itr = _container_ptr->template project<Tag>(anchor) ;
+            if ( !index.key_comp()(index.key_extractor()(*itr), cursor.lower) && in_range(index, itr, cursor.upper) ) {
+                return ++itr ;
+            }
+        }
+        auto itr = index.lower_bound(cursor.lower) ;
+        for ( std::size_t skipped = 0 ; skipped < cursor.returned && itr != index.end() ; ++skipped ) {
+            ++itr ;
+        }
+        return itr ;
+    }
+
+    /*
+     * Runs action(index, itr) on every entry matching key. A grow in the middle
+     * remaps the segment , so the range is looked up again and the entries
+     * already done are skipped.
+     */
+    template<typename Tag, typename Key, typename Action>
+    bool apply_range(const Key &key, Action action) {
+        bool is_success {false};
+        std::size_t done {} ;
+        try {
+            auto &index = _container_ptr->template get<Tag>();
+            auto p = index.equal_range(key);
+            for ( ; p.first != p.second ; ++done ) {
+                is_success |= action(index, p.first++);
+            }
+        } catch (const bad_alloc_exception_t &e) {
+            LOG(debug) << boost::core::demangle(typeid(*this).name())
+            << " data was not updated , MEMORY AVAILABLE="
+            <<  _segment_ptr->get_free_memory() ;
+            grow_memory(growth_increment());
+            auto &index = _container_ptr->template get<Tag>();
+            auto p = index.equal_range(key);
+            for ( std::size_t n = 0 ; n < done && p.first != p.second ; ++n ) {
+                ++p.first ;
+            }
+            while ( p.first != p.second ) {
+                is_success |= action(index, p.first++);
+            }
+        }
+        return is_success;
+    }
+
+    /*
+     * multi_index erases the element when a modifier throws , so bad_alloc is
+     * caught inside the modifier and re-thrown once the element is safe.
+     */
+    template<typename Index, typename Iterator, typename Fn>
+    bool modify_data(Index &index, Iterator itr, Fn &fn) {
+        bool out_of_memory {false} ;
+        bool is_success = index.modify(itr, [&](Data_t &entity) {
+            try {
+                fn(entity) ;
+            } catch (const bad_alloc_exception_t &e) {
+                out_of_memory = true ;
+            }
+        });
+        if ( out_of_memory ) {
+            throw bad_alloc_exception_t() ;
+        }
+        if ( is_success ) {
+            record_change(change_op::update, *itr) ;
+        }
+        return is_success ;
     }
  
     template<typename Serializable, typename Index, typename Iterator>
     bool update_data(const  Serializable &data, Index &index, Iterator itr) {
-        attach();
         Data_t item(_segment_ptr->get_segment_manager());
         item.store(data);
-        return index.modify(itr,item) ;
+        return modify_data(index, itr, item) ;
     }
  
     mutable boost::scoped_ptr<segment_t> _segment_ptr;
     mutable Container_t  *_container_ptr ;
+    mutable cache_header *_header_ptr ;
+    mutable change_log *_changes_ptr ;
+    mutable cache_stats *_stats_ptr ;
+    mutable std::uint64_t _generation ;
+    mutable bool _changed ; // notify subscribers when the write section ends
+    journal *_journal_ptr ;
     std::string _store_name ;
     std::string _cache_name ;
-    boost::interprocess::named_upgradable_mutex _named_mutex;
-    static const size_t MEMORY_SIZE = 67108864 ; //64M
+    mpclmi::ipc::growth_policy _growth_policy ;
+    mutable mutex_t _mutex ; // named_upgradable_mutex , in-process for Heap
+    mutable std::mutex _grow_mutex ;
+    mutable std::condition_variable _grow_cv ;
+    bool _grow_stop ;
+    std::thread _grower ;
+    static const size_t MEMORY_SIZE = 67108864 ; //64M initial size
+    static const std::size_t ENTRY_OVERHEAD = 256 ; //index nodes + allocator headers per entry
+    static const std::size_t SCAN_CHUNK = 1024 ; //entries collected per sharable lock of a scan
  
 };
  
@@ -0,0 +1,249 @@
+/*
+ * File:   event_poller.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 10:30 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __INTERACTIVE_EVENT_POLLER_HPP__
+#define __INTERACTIVE_EVENT_POLLER_HPP__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined ( __linux__ )
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined ( _WIN32 )
+#include <fcntl.h>
+#include <sys/select.h>
+#include <unistd.h>
+#else
+#include <WinSock2.h>
+#endif
+
+namespace interactive {
+
+/*
+ * Waits on the TWS socket and on a wakeup any other thread can signal with notify() ,
+ * so the dispatcher reacts to a new order as soon as it is queued instead of at
+ * the next select timeout.
+ * Linux uses epoll with an eventfd , other POSIX systems select with a self-pipe.
+ * Windows can not select on a pipe , there wait() only sleeps up to POLL_MS and
+ * notify() does nothing.
+ */
+class event_poller {
+public:
+    enum event : unsigned {
+        none = 0,
+        readable = 1,
+        writable = 2,
+        error = 4, // on the socket
+        woken = 8,
+        failed = 16 // the wait itself
+    };
+#if defined ( _WIN32 )
+    static const int POLL_MS = 10 ;
+#endif
+
+    event_poller() : _fd(-1), _want_write(false) {
+#if defined ( __linux__ )
+        _poll_fd = ::epoll_create1(EPOLL_CLOEXEC) ;
+        _wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+        if ( _poll_fd < 0 || _wake_fd < 0 ) {
+            close_all() ;
+            throw std::runtime_error("event_poller can not create epoll/eventfd") ;
+        }
+        epoll_event ev {} ;
+        ev.events = EPOLLIN ;
+        ev.data.fd = _wake_fd ;
+        if ( ::epoll_ctl(_poll_fd, EPOLL_CTL_ADD, _wake_fd, &ev) != 0 ) {
+            close_all() ;
+            throw std::runtime_error("event_poller can not watch eventfd") ;
+        }
+#elif !defined ( _WIN32 )
+        if ( ::pipe(_pipe) != 0 ) {
+            throw std::runtime_error("event_poller can not create pipe") ;
+        }
+        for ( int fd : _pipe ) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) ;
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC) ;
+        }
+#endif
+    }
+    ~event_poller() {
+        close_all() ;
+    }
+    event_poller(const event_poller &) = delete ;
+    event_poller & operator=(const event_poller &) = delete ;
+
+    // after a reconnect , the new socket may have reused the number of the old one
+    void forget() {
+        _fd = -1 ;
+    }
+
+    // any thread , wakes up a wait() in progress or the next one
+    void notify() const {
+#if defined ( __linux__ )
+        std::uint64_t one = 1 ;
+        ssize_t n = ::write(_wake_fd, &one, sizeof(one)) ; // EAGAIN only when the counter is saturated , already signalled
+        (void)n ;
+#elif !defined ( _WIN32 )
+        char c = 0 ;
+        ssize_t n = ::write(_pipe[1], &c, 1) ; // a full pipe is signalled already
+        (void)n ;
+#endif
+    }
+
+    /*
+     * Waits until fd is readable , writable when want_write , or failed , or notify()
+     * was called , at most timeout_ms (-1 waits forever). Returns a mask of event ,
+     * none on timeout.
+     */
+    unsigned wait(int fd, bool want_write, int timeout_ms) {
+#if defined ( __linux__ )
+        if ( !watch(fd, want_write) ) {
+            return failed ;
+        }
+        epoll_event events[2] ;
+        int n = ::epoll_wait(_poll_fd, events, 2, timeout_ms) ;
+        if ( n < 0 ) {
+            return errno == EINTR ? none : failed ;
+        }
+        unsigned mask = none ;
+        for ( int i = 0 ; i < n ; ++i ) {
+            if ( events[i].data.fd == _wake_fd ) {
+                std::uint64_t count ;
+                ssize_t r = ::read(_wake_fd, &count, sizeof(count)) ;
+                (void)r ;
+                mask |= woken ;
+                continue ;
+            }
+            if ( events[i].events & (EPOLLIN | EPOLLHUP) ) {
+                mask |= readable ; // a closed peer is seen by the read
+            }
+            if ( events[i].events & EPOLLOUT ) {
+                mask |= writable ;
+            }
+            if ( events[i].events & EPOLLERR ) {
+                mask |= error ;
+            }
+        }
+        return mask ;
+#else
+        fd_set read_set, write_set, error_set ;
+        FD_ZERO(&read_set) ;
+        FD_ZERO(&write_set) ;
+        FD_ZERO(&error_set) ;
+        FD_SET(fd, &read_set) ;
+        FD_SET(fd, &error_set) ;
+        if ( want_write ) {
+            FD_SET(fd, &write_set) ;
+        }
+        int max_fd = fd ;
+#if !defined ( _WIN32 )
+        FD_SET(_pipe[0], &read_set) ;
+        max_fd = std::max(fd, _pipe[0]) ;
+#else
+        if ( timeout_ms < 0 || timeout_ms > POLL_MS ) {
+            timeout_ms = POLL_MS ;
+        }
+#endif
+        struct timeval tval ;
+        tval.tv_sec = timeout_ms / 1000 ;
+        tval.tv_usec = (timeout_ms % 1000) * 1000 ;
+        int n = ::select(max_fd + 1, &read_set, &write_set, &error_set, timeout_ms < 0 ? nullptr : &tval) ;
+        if ( n <= 0 ) {
+            return n == 0 || errno == EINTR ? none : failed ;
+        }
+        unsigned mask = none ;
+#if !defined ( _WIN32 )
+        if ( FD_ISSET(_pipe[0], &read_set) ) {
+            char buf[64] ;
+            while ( ::read(_pipe[0], buf, sizeof(buf)) > 0 ) {}
+            mask |= woken ;
+        }
+#endif
+        if ( FD_ISSET(fd, &read_set) ) {
+            mask |= readable ;
+        }
+        if ( FD_ISSET(fd, &write_set) ) {
+            mask |= writable ;
+        }
+        if ( FD_ISSET(fd, &error_set) ) {
+            mask |= error ;
+        }
+        return mask ;
+#endif
+    }
+
+private:
+#if defined ( __linux__ )
+    // (re)registers the socket , it changes on reconnect and EPOLLOUT is only wanted with pending output
+    bool watch(int fd, bool want_write) {
+        if ( fd == _fd && want_write == _want_write ) {
+            return true ;
+        }
+        epoll_event ev {} ;
+        ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0) ;
+        ev.data.fd = fd ;
+        if ( fd != _fd && _fd >= 0 ) {
+            ::epoll_ctl(_poll_fd, EPOLL_CTL_DEL, _fd, nullptr) ; // fails harmlessly once the old socket is closed
+        }
+        if ( ::epoll_ctl(_poll_fd, fd == _fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0 ) {
+            // a closed socket left the set by itself , a new one may already be in it
+            int retry = errno == ENOENT ? EPOLL_CTL_ADD : errno == EEXIST ? EPOLL_CTL_MOD : -1 ;
+            if ( retry < 0 || ::epoll_ctl(_poll_fd, retry, fd, &ev) != 0 ) {
+                _fd = -1 ;
+                return false ;
+            }
+        }
+        _fd = fd ;
+        _want_write = want_write ;
+        return true ;
+    }
+#endif
+
+    void close_all() {
+#if defined ( __linux__ )
+        if ( _poll_fd >= 0 ) {
+            ::close(_poll_fd) ;
+        }
+        if ( _wake_fd >= 0 ) {
+            ::close(_wake_fd) ;
+        }
+        _poll_fd = _wake_fd = -1 ;
+#elif !defined ( _WIN32 )
+        ::close(_pipe[0]) ;
+        ::close(_pipe[1]) ;
+#endif
+    }
+
+    int _fd ; // socket currently registered
+    bool _want_write ;
+#if defined ( __linux__ )
+    int _poll_fd ;
+    int _wake_fd ;
+#elif !defined ( _WIN32 )
+    int _pipe[2] ;
+#endif
+};
+
+}
+
+#endif /* __INTERACTIVE_EVENT_POLLER_HPP__ */
@@ -32,7 +32,10 @@
 
 #include <Contract.h>
 #include <Order.h>
+#include <chrono>
+#include <cstdint>
 #include <boost/serialization/serialization.hpp>
+#include <boost/serialization/version.hpp>
 
 
 namespace boost {
@@ -76,7 +79,8 @@ enum class OrderStatus : std::int8_t {
     PENDING = 2,
     FILLED = 3,
     PARTIAL_FILL = 4,
-    ERROR_STATUS = 5
+    ERROR_STATUS = 5,
+    CANCELLED = 6
 };
 
 struct INTERACTIVE_DLL_EXPORTS OrderResponse {
@@ -104,6 +108,41 @@ struct INTERACTIVE_DLL_EXPORTS OrderResponse {
     int clientId{}; 
     IBString whyHeld{};
 };
+
+/*
+ * IB orderStatus string to OrderStatus , an empty or unknown status keeps current.
+ */
+inline OrderStatus order_status(const OrderResponse &r, OrderStatus current) {
+    const IBString &s = r.status ;
+    if ( s == "Filled" ) {
+        return OrderStatus::FILLED ;
+    }
+    if ( s == "Cancelled" || s == "ApiCancelled" ) {
+        return OrderStatus::CANCELLED ;
+    }
+    if ( s == "Submitted" || s == "PreSubmitted" ) {
+        return r.filled > 0 ? OrderStatus::PARTIAL_FILL : OrderStatus::SUBMITTED ;
+    }
+    if ( s == "PendingSubmit" || s == "PendingCancel" || s == "ApiPending" ) {
+        return OrderStatus::PENDING ;
+    }
+    if ( s == "Inactive" ) {
+        return OrderStatus::ERROR_STATUS ;
+    }
+    return current ;
+}
+
+// steady clock in ns , comparable between processes on one host , see OrderContract::enqueued_at
+inline std::int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count() ;
+}
+
+// working order , may still trade
+inline bool is_open(OrderStatus status) {
+    return status == OrderStatus::CREATED || status == OrderStatus::SUBMITTED ||
+           status == OrderStatus::PENDING || status == OrderStatus::PARTIAL_FILL ;
+}
  
 struct INTERACTIVE_DLL_EXPORTS OrderContract 
 {
@@ -129,6 +168,9 @@ struct INTERACTIVE_DLL_EXPORTS OrderContract
     void assign_order(long next_order_id) {
         order_id = order.orderId = next_order_id ;
     }
+    OrderStatus status() const {
+        return order_status(response, OrderStatus::CREATED) ;
+    }
     
     template<class Archive>
     void serialize(Archive & ar, const unsigned int version=0)
@@ -137,6 +179,9 @@ struct INTERACTIVE_DLL_EXPORTS OrderContract
         ar & order;
         ar & contract;
         ar & response;
+        if ( version > 0 ) {
+            ar & enqueued_at;
+        }
         //below for de-serialization from Archive
         account  = order.account;
         ticker   = contract.symbol;
@@ -150,7 +195,10 @@ struct INTERACTIVE_DLL_EXPORTS OrderContract
     std::string ticker{} ;
     long order_id{} ;
     OrderResponse response{};    
+    std::int64_t enqueued_at{}; // monotonic_ns() when the producer queued it , 0 if it did not
 };      
 		
 }
+
+BOOST_CLASS_VERSION(interactive::OrderContract, 1)
 #endif
@@ -0,0 +1,320 @@
+/*
+ * File:   journal.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 1:30 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __DATACACHE_JOURNAL_HPP__
+#define __DATACACHE_JOURNAL_HPP__
+
+#include "change_log.hpp"
+#include "snapshot.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/crc.hpp>
+#include <boost/log/trivial.hpp>
+
+#if !defined ( _WIN32 )
+#include <unistd.h>
+#endif
+
+namespace datacache {
+
+/*
+ * Journal record , crc covers everything after the crc field including the payload.
+ * For insert/update the payload is the entity blob , erase and clear carry none.
+ */
+struct journal_record {
+    static const std::uint32_t MAX_PAYLOAD = 1u << 26 ; // 64M , far above any entity blob
+    std::uint32_t size ; // payload bytes
+    std::uint32_t crc ;
+    std::uint64_t lsn ;
+    std::int64_t key ;
+    std::uint32_t op ;
+    std::uint32_t reserved ;
+};
+
+struct journal_options {
+    std::chrono::milliseconds commit_interval {5}; // longest a record waits for its batch
+    std::size_t batch_bytes {1 << 20}; // commit early once this much is pending
+    std::chrono::milliseconds retry_interval {1000}; // after a failed write or fsync
+    std::size_t max_pending_bytes {64 << 20}; // not durable yet , admit() holds writers off past it
+};
+
+/*
+ * Append-only write-ahead journal with group commit.
+ * append() only copies the record into the pending batch , the commit thread
+ * writes and fsyncs a whole batch once commit_interval passed or batch_bytes
+ * are pending , so writers never wait for the disk.
+ * flush() blocks until everything appended before it is durable and throws when
+ * the commit it waited for failed.
+ * A failed write or fsync is not reported durable , the file is cut back to the end
+ * of the last durable batch and the records are written again after retry_interval ,
+ * ahead of everything appended since , so a torn record never hides later ones.
+ * Records held for a failing disk are capped by max_pending_bytes , see admit() .
+ * On open a torn tail left by a crash is cut off so new records stay reachable.
+ */
+class journal {
+public:
+    explicit journal(const std::string &path, const journal_options &opts = journal_options()) :
+        _path(path), _options(opts), _file(nullptr, &std::fclose),
+        _pending(), _held(), _lsn(), _durable(), _offset(), _failures(), _failed(false), _flush(false), _stop(false),
+        _mutex(), _wake(), _durable_cv(), _committer() {
+        _offset = replay(_path, [this](change_op, std::int64_t, const char*, std::size_t, std::uint64_t lsn) {
+            _lsn = lsn ;
+        }) ;
+        _durable = _lsn ;
+        if ( !reopen() ) {
+            throw std::runtime_error("journal can not open " + _path) ;
+        }
+        _committer = std::thread([this]() { run(); }) ;
+    }
+    ~journal() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex) ;
+            _stop = true ;
+        }
+        _wake.notify_one() ;
+        _committer.join() ;
+    }
+    journal(const journal &) = delete ;
+    journal & operator=(const journal &) = delete ;
+
+    /*
+     * Called before a mutation is made. Blocks while max_pending_bytes wait for a
+     * commit that is still going through , throws once they wait for a failing disk
+     * so the mutation is refused rather than held in memory without bound.
+     */
+    void admit() {
+        std::unique_lock<std::mutex> lock(_mutex) ;
+        _durable_cv.wait(lock, [this]() { return !over_cap() || _failed || _stop ; }) ;
+        if ( over_cap() ) {
+            throw std::runtime_error("journal " + _path + " has " + std::to_string(_pending.size() + _held) +
+                                     " bytes not durable , writes are refused until the disk recovers") ;
+        }
+    }
+
+    std::uint64_t append(change_op op, std::int64_t key, const char *data, std::size_t size) {
+        if ( size > journal_record::MAX_PAYLOAD ) {
+            throw std::length_error("journal record of " + std::to_string(size) + " bytes is too large") ;
+        }
+        journal_record record {} ;
+        record.size = static_cast<std::uint32_t>(size) ;
+        record.key = key ;
+        record.op = static_cast<std::uint32_t>(op) ;
+        std::unique_lock<std::mutex> lock(_mutex) ;
+        record.lsn = ++_lsn ;
+        record.crc = checksum(record, data) ;
+        bool was_empty = _pending.empty() ;
+        const char *bytes = reinterpret_cast<const char*>(&record) ;
+        _pending.insert(_pending.end(), bytes, bytes + sizeof(record)) ;
+        _pending.insert(_pending.end(), data, data + size) ;
+        bool wake = was_empty || _pending.size() >= _options.batch_bytes ;
+        lock.unlock() ;
+        if ( wake ) {
+            _wake.notify_one() ;
+        }
+        return record.lsn ;
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(_mutex) ;
+        std::uint64_t lsn = _lsn ;
+        std::uint64_t failures = _failures ;
+        _flush = true ;
+        _wake.notify_one() ;
+        _durable_cv.wait(lock, [this, lsn, failures]() { return _durable >= lsn || _failures != failures || _stop ; }) ;
+        if ( _durable < lsn ) {
+            throw std::runtime_error("journal " + _path + " failed to make records durable") ;
+        }
+    }
+
+    // the last commit failed , appended records are held until a retry succeeds
+    bool failed() const {
+        std::lock_guard<std::mutex> lock(_mutex) ;
+        return _failed ;
+    }
+
+    std::uint64_t durable_lsn() const {
+        std::lock_guard<std::mutex> lock(_mutex) ;
+        return _durable ;
+    }
+
+    const std::string & path() const {
+        return _path ;
+    }
+
+    /*
+     * Calls fn(op, key, payload, size, lsn) for every intact record in order ,
+     * stops at the first short or corrupt one. Returns the size of the valid prefix.
+     * A payload size past MAX_PAYLOAD or the end of the file is a torn header ,
+     * it is rejected before anything is allocated for it.
+     */
+    template<typename Fn>
+    static std::uint64_t replay(const std::string &path, Fn fn) {
+        snapshot::file_ptr in(std::fopen(path.c_str(), "rb"), &std::fclose) ;
+        std::uint64_t valid {} ;
+        if ( !in ) {
+            return valid ;
+        }
+        std::uint64_t length {} ;
+        if ( std::fseek(in.get(), 0, SEEK_END) == 0 ) {
+            long end = std::ftell(in.get()) ;
+            length = end > 0 ? static_cast<std::uint64_t>(end) : 0 ;
+        }
+        std::rewind(in.get()) ;
+        journal_record record ;
+        std::vector<char> payload ;
+        while ( std::fread(&record, sizeof(record), 1, in.get()) == 1 ) {
+            if ( record.size > journal_record::MAX_PAYLOAD || valid + sizeof(record) + record.size > length ) {
+                break ;
+            }
+            payload.resize(record.size) ;
+            if ( record.size && std::fread(payload.data(), 1, record.size, in.get()) != record.size ) {
+                break ;
+            }
+            if ( checksum(record, payload.data()) != record.crc ) {
+                break ;
+            }
+            fn(static_cast<change_op>(record.op), record.key, payload.data(), payload.size(), record.lsn) ;
+            valid += sizeof(record) + record.size ;
+        }
+        return valid ;
+    }
+
+private:
+    static std::uint32_t checksum(const journal_record &record, const char *data) {
+        boost::crc_32_type crc ;
+        const char *bytes = reinterpret_cast<const char*>(&record) ;
+        crc.process_bytes(bytes + offsetof(journal_record, lsn), sizeof(record) - offsetof(journal_record, lsn)) ;
+        crc.process_bytes(data, record.size) ;
+        return crc.checksum() ;
+    }
+
+    bool over_cap() const {
+        return _pending.size() + _held >= _options.max_pending_bytes ;
+    }
+
+    bool truncate(std::uint64_t valid) {
+#if !defined ( _WIN32 )
+        snapshot::file_ptr file(std::fopen(_path.c_str(), "rb"), &std::fclose) ;
+        if ( file && std::fseek(file.get(), 0, SEEK_END) == 0 &&
+             static_cast<std::uint64_t>(std::ftell(file.get())) > valid ) {
+            BOOST_LOG_TRIVIAL(info) << _path << " dropping journal tail after " << valid << " bytes" ;
+            return ::truncate(_path.c_str(), static_cast<off_t>(valid)) == 0 ;
+        }
+#endif
+        return true ;
+    }
+
+    // closes the file first so nothing still buffered lands past the cut
+    bool reopen() {
+        _file.reset() ;
+        if ( !truncate(_offset) ) {
+            return false ;
+        }
+        _file.reset(std::fopen(_path.c_str(), "ab")) ;
+        return static_cast<bool>(_file) ;
+    }
+
+    bool write(const std::vector<char> &batch) {
+        if ( !_file && !reopen() ) {
+            return false ;
+        }
+        if ( std::fwrite(batch.data(), 1, batch.size(), _file.get()) == batch.size() && snapshot::sync(_file.get()) ) {
+            _offset += batch.size() ;
+            return true ;
+        }
+        BOOST_LOG_TRIVIAL(error) << _path << " journal write failed , " << batch.size() << " bytes not durable" ;
+        if ( !reopen() ) {
+            BOOST_LOG_TRIVIAL(error) << _path << " journal can not cut back to " << _offset << " bytes" ;
+            _file.reset() ;
+        }
+        return false ;
+    }
+
+    void run() {
+        std::vector<char> batch ; // records not durable yet , kept over a failed write
+        std::unique_lock<std::mutex> lock(_mutex) ;
+        while ( true ) {
+            if ( _failed ) {
+                _wake.wait_for(lock, _options.retry_interval, [this]() { return _stop || _flush ; }) ;
+            } else {
+                _wake.wait(lock, [this]() { return _stop || _flush || !_pending.empty() ; }) ;
+                // first record of a batch , give other writers commit_interval to join it
+                _wake.wait_for(lock, _options.commit_interval, [this]() {
+                    return _stop || _flush || _pending.size() >= _options.batch_bytes ;
+                }) ;
+            }
+            if ( _pending.empty() && batch.empty() && _stop ) {
+                break ;
+            }
+            batch.insert(batch.end(), _pending.begin(), _pending.end()) ;
+            _pending.clear() ;
+            _held = batch.size() ;
+            std::uint64_t lsn = _lsn ;
+            _flush = false ;
+            lock.unlock() ;
+            bool written = batch.empty() || write(batch) ;
+            lock.lock() ;
+            if ( written ) {
+                batch.clear() ;
+                _held = 0 ;
+                _durable = lsn ;
+                _failed = false ;
+            } else {
+                ++_failures ;
+                _failed = true ;
+            }
+            _durable_cv.notify_all() ;
+            if ( !written && _stop ) {
+                BOOST_LOG_TRIVIAL(error) << _path << " journal closed with records after lsn " << _durable << " not durable" ;
+                break ;
+            }
+        }
+        _durable_cv.notify_all() ;
+    }
+
+    std::string _path ;
+    journal_options _options ;
+    snapshot::file_ptr _file ;
+    std::vector<char> _pending ;
+    std::size_t _held ; // bytes of the batch being written or kept over a failed write
+    std::uint64_t _lsn ;
+    std::uint64_t _durable ;
+    std::uint64_t _offset ; // end of the last durable batch , committer thread only
+    std::uint64_t _failures ;
+    bool _failed ;
+    bool _flush ;
+    bool _stop ;
+    mutable std::mutex _mutex ;
+    std::condition_variable _wake ;
+    std::condition_variable _durable_cv ;
+    std::thread _committer ;
+};
+
+}
+
+#endif /* __DATACACHE_JOURNAL_HPP__ */
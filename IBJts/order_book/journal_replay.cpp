@@ -0,0 +1,106 @@
+/*
+ * File:   journal_replay.cpp
+ * Author: Vladimr Venediktov
+ *
+ * Created on October 18, 2026, 2:10 AM
+ *
+ * Rebuilds the order cache from the write-ahead journal written by order_book --journal .
+ */
+
+#include "Contract.h"
+#include "Order.h"
+
+#include "memory_types.hpp"
+#include "order_entity.hpp"
+#include "entity_cache.hpp"
+#include "journal.hpp"
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <string>
+
+namespace po = boost::program_options;
+
+using interactive::OrderContract;
+
+namespace {
+
+struct replay_stats {
+    std::size_t inserted {} ;
+    std::size_t updated {} ;
+    std::size_t erased {} ;
+    std::size_t cleared {} ;
+    std::size_t skipped {} ;
+};
+
+template<typename Memory>
+replay_stats replay(const std::string &journal_path, const std::string &cache_name) {
+    using Cache = datacache::entity_cache<Memory, ipc::data::order_container> ;
+    using Tag = typename ipc::data::order_entity<typename Cache::char_allocator>::order_tag ;
+    Cache cache(cache_name) ;
+    replay_stats stats ;
+    datacache::journal::replay(journal_path,
+        [&cache, &stats](datacache::change_op op, std::int64_t key, const char *data, std::size_t size, std::uint64_t lsn) {
+        if ( op == datacache::change_op::clear ) {
+            cache.clear() ;
+            ++stats.cleared ;
+            return ;
+        }
+        if ( op == datacache::change_op::erase ) {
+            stats.erased += cache.template erase_if<Tag>(static_cast<long>(key), [](const typename Cache::Data_t &) { return true; }) ;
+            return ;
+        }
+        if ( op != datacache::change_op::insert && op != datacache::change_op::update ) {
+            ++stats.skipped ;
+            return ;
+        }
+        OrderContract value ;
+        ipc::data::blob_codec<OrderContract>::load(data, size, value) ;
+        value.assign_order(key) ; //archive blobs do not carry order.orderId
+        // replaying over a non empty cache , last image of the order wins
+        if ( cache.template update<Tag>(value, static_cast<long>(key)) ) {
+            ++stats.updated ;
+        } else if ( cache.insert(value) ) {
+            ++stats.inserted ;
+        } else {
+            std::cerr << "lsn=" << lsn << " order_id=" << key << " could not be replayed" << std::endl ;
+            ++stats.skipped ;
+        }
+    }) ;
+    return stats ;
+}
+
+}
+
+int main(int argc, char **argv) {
+    po::variables_map vm;
+    po::options_description desc("Allowed options");
+    std::string journal_path ;
+    std::string cache_name ;
+    desc.add_options()
+            ("help,h", "display help screen")
+            ("journal,j",  po::value<std::string>(&journal_path)->required(), "journal file to replay")
+            ("cache,c",  po::value<std::string>(&cache_name)->default_value("order_book_cache"), "name of the cache to rebuild")
+            ("mapped,m", "rebuild the mapped file cache instead of shared memory");
+
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help") ) {
+            std::clog << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const boost::program_options::error &e) {
+        std::cerr << desc << std::endl;
+        return -1;
+    }
+
+    replay_stats stats = vm.count("mapped") ? replay<mpclmi::ipc::Mapped>(journal_path, cache_name) :
+                                              replay<mpclmi::ipc::Shared>(journal_path, cache_name) ;
+    std::cout << journal_path << " -> " << cache_name
+              << " inserted=" << stats.inserted
+              << " updated=" << stats.updated
+              << " erased=" << stats.erased
+              << " cleared=" << stats.cleared
+              << " skipped=" << stats.skipped << std::endl ;
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * File:   latency_trace.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 11:45 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __INTERACTIVE_LATENCY_TRACE_HPP__
+#define __INTERACTIVE_LATENCY_TRACE_HPP__
+
+#include "interactive.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iterator>
+#include <ostream>
+#include <unordered_map>
+
+namespace interactive {
+
+/*
+ * HDR style histogram of nanoseconds , every power of two is split in 2^(SUB_BITS-1)
+ * buckets so a value is kept to about 3% , exact below 2^SUB_BITS , values past
+ * 2^MAX_BITS (about 18 minutes) land in the last bucket.
+ * record() is one relaxed atomic add , another thread can read it at any time.
+ */
+class latency_histogram {
+public:
+    static const unsigned SUB_BITS = 6 ;
+    static const unsigned MAX_BITS = 40 ;
+    static const std::size_t HALF = std::size_t(1) << (SUB_BITS - 1) ;
+    static const std::size_t BUCKETS = (MAX_BITS - SUB_BITS + 3) * HALF ;
+
+    latency_histogram() : _max(0) {
+        for ( auto &b : _buckets ) { b.store(0, std::memory_order_relaxed) ; }
+    }
+
+    void record(std::int64_t ns) {
+        std::uint64_t v = ns > 0 ? static_cast<std::uint64_t>(ns) : 0 ;
+        _buckets[index_of(v)].fetch_add(1, std::memory_order_relaxed) ;
+        std::uint64_t max = _max.load(std::memory_order_relaxed) ;
+        while ( v > max && !_max.compare_exchange_weak(max, v, std::memory_order_relaxed) ) {}
+    }
+
+    std::uint64_t count() const {
+        std::uint64_t n {} ;
+        for ( const auto &b : _buckets ) { n += b.load(std::memory_order_relaxed) ; }
+        return n ;
+    }
+
+    // highest value of the bucket holding the p-th percentile , 0 when empty
+    std::uint64_t percentile(double p) const {
+        std::uint64_t total = count() , seen {} ;
+        for ( std::size_t i = 0 ; i < BUCKETS && total ; ++i ) {
+            seen += _buckets[i].load(std::memory_order_relaxed) ;
+            if ( seen * 100.0 >= p * total ) {
+                return std::min(highest_of(i), max()) ;
+            }
+        }
+        return 0 ;
+    }
+
+    std::uint64_t max() const {
+        return _max.load(std::memory_order_relaxed) ;
+    }
+
+private:
+    static std::size_t index_of(std::uint64_t v) {
+        if ( v < 2 * HALF ) {
+            return static_cast<std::size_t>(v) ;
+        }
+        unsigned msb {} ;
+        for ( std::uint64_t x = v ; x >>= 1 ; ) { ++msb ; }
+        unsigned shift = msb - SUB_BITS + 1 ;
+        std::size_t index = (shift + 1) * HALF + static_cast<std::size_t>((v >> shift) - HALF) ;
+        return index < BUCKETS ? index : BUCKETS - 1 ;
+    }
+
+    static std::uint64_t highest_of(std::size_t index) {
+        if ( index < 2 * HALF ) {
+            return index ;
+        }
+        unsigned shift = static_cast<unsigned>(index / HALF - 1) ;
+        std::uint64_t sub = index % HALF + HALF ;
+        return ((sub + 1) << shift) - 1 ;
+    }
+
+    std::atomic<std::uint64_t> _buckets[BUCKETS] ;
+    std::atomic<std::uint64_t> _max ;
+};
+
+/*
+ * Where an order spends its time between the producer and the first orderStatus :
+ *   queue - producer enqueued it until the feeder took it off the message queue
+ *   inbox - waiting in the OrderBook inbox , for the dispatcher or an order id
+ *   send  - placeOrder until the batch it was encoded in was written to the socket
+ *   ack   - the batch was written until the first orderStatus for the order
+ *   total - producer enqueued it until the first orderStatus
+ * Timestamps are monotonic_ns() , so queue and total need the producer on the same host.
+ * placed() and acknowledged() run on the dispatcher thread , dump() on any.
+ */
+class order_trace {
+public:
+    enum stage { queue = 0, inbox, send, ack, total, STAGE_COUNT } ;
+
+    void placed(long order_id, std::int64_t enqueued, std::int64_t dequeued,
+                std::int64_t dispatched, std::int64_t sent) {
+        if ( enqueued ) {
+            _stages[queue].record(dequeued - enqueued) ;
+        }
+        _stages[inbox].record(dispatched - dequeued) ;
+        _stages[send].record(sent - dispatched) ;
+        if ( _pending.size() >= MAX_PENDING ) {
+            prune(sent) ;
+        }
+        _pending[order_id] = pending_order{enqueued, sent} ;
+    }
+
+    // every orderStatus , only the first one of an order is recorded
+    void acknowledged(long order_id, std::int64_t at) {
+        auto itr = _pending.find(order_id) ;
+        if ( itr == _pending.end() ) {
+            return ;
+        }
+        _stages[ack].record(at - itr->second.sent) ;
+        if ( itr->second.enqueued ) {
+            _stages[total].record(at - itr->second.enqueued) ;
+        }
+        _pending.erase(itr) ;
+    }
+
+    void dump(std::ostream &out) const {
+        static const char *names[STAGE_COUNT] = { "queue", "inbox", "send", "ack", "total" } ;
+        std::ios::fmtflags flags = out.flags() ;
+        std::streamsize precision = out.precision() ;
+        out << std::left << std::setw(7) << "stage" << std::right
+            << std::setw(10) << "count" << std::setw(12) << "p50 us" << std::setw(12) << "p90 us"
+            << std::setw(12) << "p99 us" << std::setw(12) << "p99.9 us" << std::setw(12) << "max us" << '\n' ;
+        for ( std::size_t i = 0 ; i < STAGE_COUNT ; ++i ) {
+            const latency_histogram &h = _stages[i] ;
+            out << std::left << std::setw(7) << names[i] << std::right << std::setw(10) << h.count()
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << h.percentile(50) / 1e3 << std::setw(12) << h.percentile(90) / 1e3
+                << std::setw(12) << h.percentile(99) / 1e3 << std::setw(12) << h.percentile(99.9) / 1e3
+                << std::setw(12) << h.max() / 1e3 << '\n' ;
+        }
+        out.flags(flags) ;
+        out.precision(precision) ;
+    }
+
+    const latency_histogram & operator[](stage s) const {
+        return _stages[s] ;
+    }
+
+private:
+    static const std::size_t MAX_PENDING = 4096 ;
+    static const std::int64_t PENDING_NS = 60000000000LL ; // orders never acknowledged are dropped after a minute
+
+    struct pending_order {
+        std::int64_t enqueued ;
+        std::int64_t sent ;
+    };
+
+    void prune(std::int64_t now) {
+        for ( auto itr = _pending.begin() ; itr != _pending.end() ; ) {
+            itr = now - itr->second.sent > PENDING_NS ? _pending.erase(itr) : std::next(itr) ;
+        }
+        if ( _pending.size() >= MAX_PENDING ) {
+            _pending.clear() ;
+        }
+    }
+
+    std::unordered_map<long, pending_order> _pending ;
+    latency_histogram _stages[STAGE_COUNT] ;
+};
+
+}
+
+#endif /* __INTERACTIVE_LATENCY_TRACE_HPP__ */
@@ -23,15 +23,77 @@
 #include <boost/interprocess/managed_mapped_file.hpp> //Variant-II , open(), mmap()
 #include <boost/interprocess/managed_heap_memory.hpp> // Variant III for heap
 #include <boost/interprocess/creation_tags.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/sync/named_upgradable_mutex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#if defined ( __linux__ )
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include <boost/thread/locks.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
 namespace mpclmi { namespace ipc {
+
+/*
+ * When and by how much a cache segment grows.
+ * low_watermark  - fraction of the segment size , once free memory drops below it
+ *                  the segment is grown ahead of the next bad_alloc
+ * growth_factor  - segment grows to size * growth_factor
+ * min_increment  - smallest single grow
+ * background     - grow from a helper thread instead of the writer that crossed
+ *                  the watermark , only for policies with named segments
+ */
+struct growth_policy {
+    double low_watermark {0.10};
+    double growth_factor {1.5};
+    std::size_t min_increment {67108864}; //64M
+    bool background {false};
+
+    bool below_watermark(std::size_t free_memory, std::size_t size) const {
+        return free_memory < static_cast<std::size_t>(size * low_watermark) ;
+    }
+    std::size_t increment(std::size_t size) const {
+        std::size_t by_factor = growth_factor > 1.0 ? static_cast<std::size_t>(size * (growth_factor - 1.0)) : 0 ;
+        return std::max(by_factor, min_increment) ;
+    }
+};
    
+/*
+ * In-process stand-in for named_upgradable_mutex with the same exclusive and
+ * sharable interface over boost::shared_mutex , the name is ignored.
+ * Lets entity_cache lock a Heap segment the same way it locks a named one.
+ */
+class local_upgradable_mutex {
+public:
+    local_upgradable_mutex(boost::interprocess::open_or_create_t, const char *) : _mutex() {}
+    local_upgradable_mutex(const local_upgradable_mutex &) = delete ;
+    local_upgradable_mutex & operator=(const local_upgradable_mutex &) = delete ;
+    void lock() { _mutex.lock() ; }
+    bool try_lock() { return _mutex.try_lock() ; }
+    void unlock() { _mutex.unlock() ; }
+    void lock_sharable() { _mutex.lock_shared() ; }
+    bool try_lock_sharable() { return _mutex.try_lock_shared() ; }
+    void unlock_sharable() { _mutex.unlock_shared() ; }
+private:
+    boost::shared_mutex _mutex ;
+};
+
 struct Shared {
+    static const bool named = true ; // segment can be opened and grown by name from any thread or process
+    static const bool persistent = false ; // segment is backed by a file that survives a restart
     typedef boost::interprocess::managed_shared_memory   segment_t;
     typedef boost::interprocess::managed_shared_memory::segment_manager  segment_manager_t;
+    typedef boost::interprocess::named_upgradable_mutex mutex_t ; // guards the segment across processes
     typedef boost::shared_mutex lock_t ;
     typedef boost::unique_lock<lock_t>  scoped_exclusive_locker_t;
     typedef boost::shared_lock<lock_t>  scoped_shared_locker_t;
@@ -51,14 +113,29 @@ struct Shared {
         mem_ptr.reset(open_segment(path)) ;
         return ;
     }
+    // map the segment again after another process has grown it
+    template <typename MemPtr>
+    static void remap(MemPtr &mem_ptr, const std::string &path) {
+        mem_ptr.reset(open_segment(path)) ;
+    }
+    // grow by name while nobody in this process has it mapped
+    static bool grow(const std::string &path, size_t size) {
+        return segment_t::grow(path.c_str(), size) ;
+    }
     static std::string convert_base_dir(const std::string &base_dir) {
         return "" ;
     }
+    static bool flush(segment_t &segment) {
+        return false ;
+    }
 };  
 
 struct Mapped {
+    static const bool named = true ;
+    static const bool persistent = true ;
     typedef boost::interprocess::managed_mapped_file   segment_t;  
     typedef boost::interprocess::managed_mapped_file::segment_manager segment_manager_t;
+    typedef boost::interprocess::named_upgradable_mutex mutex_t ;
     typedef boost::shared_mutex lock_t ;
     typedef boost::unique_lock<lock_t>  scoped_exclusive_locker_t;
     typedef boost::shared_lock<lock_t>  scoped_shared_locker_t;
@@ -78,14 +155,27 @@ struct Mapped {
         mem_ptr.reset(open_segment(path)) ;
         return ;
     }
+    template <typename MemPtr>
+    static void remap(MemPtr &mem_ptr, const std::string &path) {
+        mem_ptr.reset(open_segment(path)) ;
+    }
+    static bool grow(const std::string &path, size_t size) {
+        return segment_t::grow(path.c_str(), size) ;
+    }
     static std::string convert_base_dir(const std::string &base_dir) {
         return base_dir + "/";
     }
+    static bool flush(segment_t &segment) {
+        return segment.flush() ; // msync
+    }
 };
 
 struct Heap {
+    static const bool named = false ;
+    static const bool persistent = false ;
     typedef boost::interprocess::managed_heap_memory   segment_t;
     typedef boost::interprocess::managed_heap_memory::segment_manager  segment_manager_t;
+    typedef local_upgradable_mutex mutex_t ; // segment is private to the process
     typedef boost::shared_mutex lock_t ;
     typedef boost::unique_lock<lock_t>  scoped_exclusive_locker_t;
     typedef boost::shared_lock<lock_t>  scoped_shared_locker_t;
@@ -100,9 +190,196 @@ struct Heap {
         mem_ptr->grow(size) ;
         return ;
     }
+    // nobody else can grow a heap segment , the mapping is always current
+    template <typename MemPtr>
+    static void remap(MemPtr &mem_ptr, const std::string &path) {}
     static std::string convert_base_dir(const std::string &base_dir) {
         return "" ;
     }
+    static bool flush(segment_t &segment) {
+        return false ;
+    }
+};
+
+enum class huge_page_mode : std::int8_t {
+    none = 0,      // 4KB pages
+    hugetlbfs = 1, // segment file lives on a hugetlbfs mount
+    thp = 2        // tmpfs file , madvise(MADV_HUGEPAGE) and shmem transparent huge pages
+};
+
+/*
+ * Segment backed by huge pages , a managed_mapped_file like Mapped but placed on
+ * a hugetlbfs mount when there is one , otherwise on /dev/shm with madvise(MADV_HUGEPAGE)
+ * which the kernel honours when shmem transparent huge pages are not disabled.
+ * Without either it degrades to the same 4KB pages as Shared , see mode() .
+ * A hugetlbfs mount is only used when it has 2M pages and its pool has free ones ,
+ * a segment that still can not be created there (the pool ran dry) moves this process
+ * to /dev/shm for good , resolve() maps the hugetlbfs path to the one actually used.
+ * Sizes are rounded up to the huge page size , hugetlbfs refuses anything else.
+ */
+struct HugePage {
+    static const bool named = true ;
+    static const bool persistent = false ; // hugetlbfs and tmpfs do not survive a reboot
+    static const std::size_t PAGE_SIZE = 2097152 ; //2M
+    typedef boost::interprocess::managed_mapped_file   segment_t;
+    typedef boost::interprocess::managed_mapped_file::segment_manager segment_manager_t;
+    typedef boost::interprocess::named_upgradable_mutex mutex_t ;
+    typedef boost::shared_mutex lock_t ;
+    typedef boost::unique_lock<lock_t>  scoped_exclusive_locker_t;
+    typedef boost::shared_lock<lock_t>  scoped_shared_locker_t;
+    static segment_t * open_or_create_segment (const std::string &path, size_t size) {
+        if ( on_hugetlbfs() && ::access(fallback(path).c_str(), F_OK) == 0 ) {
+            fallen_back() = true ; // another process already moved the segment to /dev/shm
+        }
+        if ( on_hugetlbfs() ) {
+            try {
+                return advise(new segment_t(boost::interprocess::open_or_create, path.c_str(), round_up(size))) ;
+            } catch (const boost::interprocess::interprocess_exception &e) {
+                fall_back(path) ;
+            }
+        }
+        return advise(new segment_t(boost::interprocess::open_or_create, resolve(path).c_str(), round_up(size))) ;
+    }
+    static segment_t * open_segment (const std::string &path) {
+        return advise(new segment_t(boost::interprocess::open_only, resolve(path).c_str())) ;
+    }
+    static segment_t * create_segment (const std::string &path, size_t size) {
+        if ( on_hugetlbfs() ) {
+            try {
+                return advise(new segment_t(boost::interprocess::create_only, path.c_str(), round_up(size))) ;
+            } catch (const boost::interprocess::interprocess_exception &e) {
+                fall_back(path) ;
+            }
+        }
+        return advise(new segment_t(boost::interprocess::create_only, resolve(path).c_str(), round_up(size))) ;
+    }
+    template <typename MemPtr>
+    static void grow( MemPtr &mem_ptr, const std::string &path, size_t size) {
+        mem_ptr.reset() ;
+        grow(path, size) ;
+        mem_ptr.reset(open_segment(path)) ;
+    }
+    template <typename MemPtr>
+    static void remap(MemPtr &mem_ptr, const std::string &path) {
+        mem_ptr.reset(open_segment(path)) ;
+    }
+    static bool grow(const std::string &path, size_t size) {
+        return segment_t::grow(resolve(path).c_str(), round_up(size)) ;
+    }
+    static std::string convert_base_dir(const std::string &base_dir) {
+        return mount().first + "/" ;
+    }
+    static bool flush(segment_t &segment) {
+        return false ;
+    }
+    static huge_page_mode mode() {
+        return fallen_back() ? shm_mode() : mount().second ;
+    }
+    // file the segment named path (under convert_base_dir) really lives in
+    static std::string resolve(const std::string &path) {
+        return fallen_back() ? fallback(path) : path ;
+    }
+    static std::size_t round_up(std::size_t size) {
+        return (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE ;
+    }
+private:
+    static segment_t * advise(segment_t *segment) {
+#if defined ( MADV_HUGEPAGE )
+        if ( mode() == huge_page_mode::thp ) {
+            ::madvise(segment->get_address(), segment->get_size(), MADV_HUGEPAGE) ;
+        }
+#endif
+        return segment ;
+    }
+    // directory the segment files go to and the kind of pages it gets , probed once
+    static const std::pair<std::string, huge_page_mode> & mount() {
+        static const std::pair<std::string, huge_page_mode> probed = probe() ;
+        return probed ;
+    }
+    static std::pair<std::string, huge_page_mode> probe() {
+#if defined ( __linux__ )
+        std::ifstream mounts("/proc/mounts") ;
+        std::string device, dir, type, options, rest ;
+        while ( mounts >> device >> dir >> type >> options && std::getline(mounts, rest) ) {
+            if ( type == "hugetlbfs" && ::access(dir.c_str(), W_OK) == 0 && page_size_kb(options) == PAGE_SIZE / 1024 &&
+                 free_huge_pages() > 0 ) {
+                return std::make_pair(dir, huge_page_mode::hugetlbfs) ;
+            }
+        }
+        return std::make_pair(std::string(SHM_DIR), shm_mode()) ;
+#else
+        return std::make_pair(std::string("/tmp"), huge_page_mode::none) ;
+#endif
+    }
+    static bool on_hugetlbfs() {
+        return mount().second == huge_page_mode::hugetlbfs && !fallen_back() ;
+    }
+    static std::atomic<bool> & fallen_back() {
+        static std::atomic<bool> flag {false} ;
+        return flag ;
+    }
+    static void fall_back(const std::string &path) {
+        std::remove(path.c_str()) ; // mapping it failed , nobody uses it
+        fallen_back() = true ;
+    }
+    static std::string fallback(const std::string &path) {
+        const std::string &dir = mount().first ;
+        if ( mount().second != huge_page_mode::hugetlbfs || path.compare(0, dir.size() + 1, dir + "/") != 0 ) {
+            return path ;
+        }
+        return std::string(SHM_DIR) + path.substr(dir.size()) ;
+    }
+    // pages of /dev/shm , probed once
+    static huge_page_mode shm_mode() {
+        static const huge_page_mode probed = []() -> huge_page_mode {
+#if defined ( __linux__ )
+            std::ifstream shmem("/sys/kernel/mm/transparent_hugepage/shmem_enabled") ;
+            std::string setting ;
+            while ( shmem >> setting ) {
+                if ( setting.front() == '[' ) {
+                    return setting != "[never]" && setting != "[deny]" ? huge_page_mode::thp : huge_page_mode::none ;
+                }
+            }
+#endif
+            return huge_page_mode::none ;
+        }() ;
+        return probed ;
+    }
+    // pagesize= of a hugetlbfs mount , the default huge page size without one
+    static std::size_t page_size_kb(const std::string &options) {
+        std::size_t at = options.find("pagesize=") ;
+        if ( at == std::string::npos ) {
+            return meminfo("Hugepagesize:") ;
+        }
+        std::size_t end {} ;
+        std::size_t size = std::stoul(options.substr(at + 9), &end) ;
+        switch ( end < options.size() - at - 9 ? options[at + 9 + end] : 'K' ) {
+            case 'G' : case 'g' : return size * 1024 * 1024 ;
+            case 'M' : case 'm' : return size * 1024 ;
+            default : return size ;
+        }
+    }
+    static std::size_t free_huge_pages() {
+        std::ifstream pool("/sys/kernel/mm/hugepages/hugepages-" + std::to_string(PAGE_SIZE / 1024) + "kB/free_hugepages") ;
+        std::size_t free {} ;
+        if ( pool >> free ) {
+            return free ;
+        }
+        return meminfo("HugePages_Free:") ;
+    }
+    static std::size_t meminfo(const std::string &key) {
+        std::ifstream info("/proc/meminfo") ;
+        std::string name ;
+        std::size_t value {} ;
+        while ( info >> name >> value ) {
+            if ( name == key ) {
+                return value ;
+            }
+            info.ignore(256, '\n') ;
+        }
+        return 0 ;
+    }
+    static constexpr const char *SHM_DIR = "/dev/shm" ;
 };
 
 }}
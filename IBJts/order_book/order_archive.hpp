@@ -0,0 +1,190 @@
+/*
+ * File:   order_archive.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 3:00 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __IPC_DATA_ORDER_ARCHIVE_HPP__
+#define __IPC_DATA_ORDER_ARCHIVE_HPP__
+
+#include "interactive.hpp"
+#include "snapshot.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/crc.hpp>
+#include <boost/tuple/tuple.hpp>
+
+namespace ipc { namespace data {
+
+/*
+ * Archive record , the payload is the entity blob as stored in the cache
+ * (a flat order_record for most orders) , crc covers header fields after it and the payload.
+ */
+struct archive_record {
+    static const std::uint32_t MAX_PAYLOAD = 1u << 26 ; // 64M , far above any entity blob
+    std::uint32_t size ;
+    std::uint32_t crc ;
+    std::int64_t order_id ;
+    std::int64_t updated_at ;
+    std::int32_t status ;
+    std::uint32_t reserved ;
+};
+
+/*
+ * Append-only file of orders evicted from the live cache.
+ */
+class order_archive {
+public:
+    explicit order_archive(const std::string &path) :
+        _path(path), _file(std::fopen(path.c_str(), "ab"), &std::fclose) {
+        if ( !_file ) {
+            throw std::runtime_error("order_archive can not open " + path) ;
+        }
+    }
+
+    bool append(std::int64_t order_id, std::int64_t updated_at, interactive::OrderStatus status,
+                const char *data, std::size_t size) {
+        if ( size > archive_record::MAX_PAYLOAD ) {
+            throw std::length_error("order_archive record of " + std::to_string(size) + " bytes is too large") ;
+        }
+        archive_record record {} ;
+        record.size = static_cast<std::uint32_t>(size) ;
+        record.order_id = order_id ;
+        record.updated_at = updated_at ;
+        record.status = static_cast<std::int32_t>(status) ;
+        record.crc = checksum(record, data) ;
+        return std::fwrite(&record, sizeof(record), 1, _file.get()) == 1 &&
+               std::fwrite(data, 1, size, _file.get()) == size ;
+    }
+
+    // appended records are durable once this returns true
+    bool sync() {
+        return datacache::snapshot::sync(_file.get()) ;
+    }
+
+    const std::string & path() const {
+        return _path ;
+    }
+
+    /*
+     * Calls fn(const archive_record &, payload, size) for every intact record ,
+     * stops at the first short or corrupt one. Returns number of records read.
+     * A payload size past MAX_PAYLOAD or the end of the file is a torn header ,
+     * it is rejected before anything is allocated for it.
+     */
+    template<typename Fn>
+    static std::size_t read(const std::string &path, Fn fn) {
+        datacache::snapshot::file_ptr in(std::fopen(path.c_str(), "rb"), &std::fclose) ;
+        std::size_t n {} ;
+        if ( !in ) {
+            return n ;
+        }
+        std::uint64_t length {} ;
+        if ( std::fseek(in.get(), 0, SEEK_END) == 0 ) {
+            long end = std::ftell(in.get()) ;
+            length = end > 0 ? static_cast<std::uint64_t>(end) : 0 ;
+        }
+        std::rewind(in.get()) ;
+        std::uint64_t valid {} ;
+        archive_record record ;
+        std::vector<char> payload ;
+        while ( std::fread(&record, sizeof(record), 1, in.get()) == 1 ) {
+            if ( record.size > archive_record::MAX_PAYLOAD || valid + sizeof(record) + record.size > length ) {
+                break ;
+            }
+            payload.resize(record.size) ;
+            if ( record.size && std::fread(payload.data(), 1, record.size, in.get()) != record.size ) {
+                break ;
+            }
+            if ( checksum(record, payload.data()) != record.crc ) {
+                break ;
+            }
+            fn(static_cast<const archive_record &>(record), payload.data(), payload.size()) ;
+            valid += sizeof(record) + record.size ;
+            ++n ;
+        }
+        return n ;
+    }
+
+private:
+    static std::uint32_t checksum(const archive_record &record, const char *data) {
+        boost::crc_32_type crc ;
+        const char *bytes = reinterpret_cast<const char*>(&record) ;
+        crc.process_bytes(bytes + offsetof(archive_record, order_id), sizeof(record) - offsetof(archive_record, order_id)) ;
+        crc.process_bytes(data, record.size) ;
+        return crc.checksum() ;
+    }
+
+    std::string _path ;
+    datacache::snapshot::file_ptr _file ;
+};
+
+/*
+ * Moves orders that sit in a terminal state for longer than age from the cache into
+ * the archive , returns number of evicted orders.
+ * Candidates are copied out under the sharable lock and made durable in the archive
+ * before anything is erased , the exclusive lock is then taken once per status and
+ * only erases orders not touched since they were archived.
+ * Works with entity_cache and sharded_entity_cache over order_entity.
+ */
+template<typename Cache>
+std::size_t evict_terminal(Cache &cache, order_archive &archive, std::chrono::nanoseconds age) {
+    using Entity = typename Cache::Data_t ;
+    using Tag = typename Entity::status_account_tag ;
+    const interactive::OrderStatus terminal[] = { interactive::OrderStatus::FILLED, interactive::OrderStatus::CANCELLED } ;
+    const std::int64_t cutoff = Entity::now() - age.count() ;
+    std::size_t evicted {} ;
+    for ( interactive::OrderStatus status : terminal ) {
+        std::unordered_map<long, std::int64_t> archived ;
+        std::vector<archive_record> records ;
+        std::vector<std::string> payloads ;
+        cache.template visit<Tag>(boost::make_tuple(status), [&](const Entity &entity) {
+            if ( entity.updated_at <= cutoff && archived.emplace(entity.order_id, entity.updated_at).second ) {
+                archive_record record {} ;
+                record.order_id = entity.order_id ;
+                record.updated_at = entity.updated_at ;
+                records.push_back(record) ;
+                payloads.emplace_back(entity.blob.data(), entity.blob.size()) ;
+            }
+        }) ;
+        if ( archived.empty() ) {
+            continue ;
+        }
+        bool is_success {true} ;
+        for ( std::size_t i = 0 ; i < records.size() ; ++i ) {
+            is_success &= archive.append(records[i].order_id, records[i].updated_at, status,
+                                         payloads[i].data(), payloads[i].size()) ;
+        }
+        if ( !is_success || !archive.sync() ) {
+            throw std::runtime_error("order_archive write failed " + archive.path()) ;
+        }
+        evicted += cache.template erase_if<Tag>(boost::make_tuple(status), [&archived](const Entity &entity) {
+            auto itr = archived.find(entity.order_id) ;
+            return itr != archived.end() && itr->second == entity.updated_at ;
+        }) ;
+    }
+    return evicted ;
+}
+
+}}
+
+#endif /* __IPC_DATA_ORDER_ARCHIVE_HPP__ */
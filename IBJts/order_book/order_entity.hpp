@@ -20,13 +20,22 @@
 #define __IPC_DATA_ORDER_ENTITY_HPP__
  
 #include "interactive.hpp"
+#include "order_record.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
 #include <boost/interprocess/containers/string.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/composite_key.hpp>
 #include <boost/archive/binary_iarchive.hpp>
@@ -43,6 +52,12 @@ namespace ipc { namespace data {
         struct account_ticker_tag {}; // search on account+ticker or account
         struct status_account_tag {}; // search on status+account or status
         struct order_tag {}; //unique index
+        using primary_tag = order_tag ; //sharded_entity_cache routes on it
+
+        template<typename Serializable>
+        static long primary_key(const Serializable &data) {
+            return data.order_id ;
+        }
        
         order_entity( const Alloc & a ) :
         _allocator(a),
@@ -50,6 +65,7 @@ namespace ipc { namespace data {
         ticker(a),
         order_id(),
         order_status(interactive::OrderStatus::CREATED),// this is for search of orders by status
+        updated_at(),
         blob(a)
         {} //ctor END
        
@@ -58,37 +74,60 @@ namespace ipc { namespace data {
         char_string ticker;
         long order_id;
         interactive::OrderStatus order_status;
+        std::int64_t updated_at; // nanoseconds since epoch of the last store/add_response , for retention
         char_string blob;
+
+        static std::int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count() ;
+        }
  
         template<typename Serializable>
         void store(const Serializable  &data)  {       
-            std::stringstream ss;
-            boost::archive::binary_oarchive oarch(ss);
-            oarch << data ;
-            std::string blob_str = std::move(ss.str()) ;
-            blob = char_string(blob_str.data(), blob_str.length(), _allocator) ;
+            blob_codec<Serializable>::store(data, blob) ;
             //Store keys
             account  = char_string(data.account.data(), data.account.size(), _allocator);
             ticker   = char_string(data.ticker.data(), data.ticker.size(), _allocator) ;
             order_id = data.order_id;
+            order_status = data.status() ;
+            updated_at = now() ;
         }
         template<typename Serializable>
         static std::size_t size(const Serializable &data) {
-            std::stringstream ss;
-            boost::archive::binary_oarchive oarch(ss);
-            oarch << data ;
-            return sizeof(data._allocator)       +
-                   sizeof(data.account)          +
-                   sizeof(data.ticker)           +
-                   sizeof(data.order_id)         +
-                   sizeof(data.order_status)     +
-                   ss.str().size() ;
+            return sizeof(order_entity)          +
+                   data.account.size()           +
+                   data.ticker.size()            +
+                   blob_codec<Serializable>::size(data) ;
         }
         template<typename Serializable>
         void retrieve(Serializable  &data) const {           
-            std::stringstream ss (std::string(blob.data(),blob.length()));
-            boost::archive::binary_iarchive iarch(ss);
-            iarch >> data;
+            load(blob.data(), blob.length(), data) ;
+        }
+        // decode a copy of the blob , see entity_cache::scan
+        template<typename Serializable>
+        static void load(const char *data, std::size_t size, Serializable &out) {
+            blob_codec<Serializable>::load(data, size, out) ;
+        }
+        /*
+         * Patch the response of a stored OrderContract , for entity_cache::modify.
+         * A flat order_record is overwritten in place , an archive blob (or a response
+         * that does not fit the record) goes through a decode/encode round trip.
+         */
+        void add_response(const interactive::OrderResponse &response) {
+            order_status = interactive::order_status(response, order_status) ;
+            updated_at = now() ;
+            const record_header *header = record::header_of(blob.data(), blob.size()) ;
+            order_record::response_section section ;
+            if ( header && header->version == order_record::VERSION && blob.size() == sizeof(order_record) &&
+                 record::encode(response, section) ) {
+                std::memcpy(&blob[0] + offsetof(order_record, response), &section, sizeof(section)) ;
+                return ;
+            }
+            interactive::OrderContract data ;
+            retrieve(data) ;
+            data.assign_order(order_id) ; //archive blobs do not carry order.orderId
+            data.add_response(response) ;
+            store(data) ;
         }
         //needed for ability to update after matching by calling index.modify(itr,entry)
         void operator()(order_entity &entry) const {
@@ -96,6 +135,7 @@ namespace ipc { namespace data {
             entry.ticker=ticker;
             entry.order_id=order_id;
             entry.order_status=order_status;
+            entry.updated_at=updated_at;
             entry.blob=blob;
         }
     } ;
@@ -130,7 +170,63 @@ boost::multi_index_container<
     >,
     boost::interprocess::allocator<order_entity<Alloc>,typename Alloc::segment_manager>
 > ;
-  
+
+/*
+ * Same entity and secondary indexes as order_container , but the primary
+ * order_id index is hashed_unique for O(1) point lookups.
+ * Ordered scans over order_id are not available with this variant.
+ */
+template<typename Alloc>
+using order_hashed_container =
+boost::multi_index_container<
+    order_entity<Alloc>,
+    boost::multi_index::indexed_by<
+        boost::multi_index::hashed_unique<
+            boost::multi_index::tag<typename order_entity<Alloc>::order_tag>,
+                BOOST_MULTI_INDEX_MEMBER(order_entity<Alloc>,long,order_id)
+        >,
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<typename order_entity<Alloc>::account_ticker_tag>,
+            boost::multi_index::composite_key<
+                order_entity<Alloc>,
+                BOOST_MULTI_INDEX_MEMBER(order_entity<Alloc>,typename order_entity<Alloc>::char_string,account),
+                BOOST_MULTI_INDEX_MEMBER(order_entity<Alloc>,typename order_entity<Alloc>::char_string,ticker)
+            >
+        >,
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<typename order_entity<Alloc>::status_account_tag>,
+            boost::multi_index::composite_key<
+                order_entity<Alloc>,
+                BOOST_MULTI_INDEX_MEMBER(order_entity<Alloc>,interactive::OrderStatus,order_status),
+                BOOST_MULTI_INDEX_MEMBER(order_entity<Alloc>,typename order_entity<Alloc>::char_string,account)
+            >
+        >
+    >,
+    boost::interprocess::allocator<order_entity<Alloc>,typename Alloc::segment_manager>
+> ;
+
+/*
+ * Working orders of an account , one status_account_tag lookup per open status
+ * in a single section instead of decoding every order of the account , the account
+ * key is built inside it , see entity_cache::retrieve_many_with .
+ * Works with entity_cache and sharded_entity_cache over order_entity.
+ */
+template<typename Cache, typename Serializable>
+std::size_t open_orders(Cache &cache, std::vector<std::shared_ptr<Serializable>> &entries, const std::string &account) {
+    using Entity = typename Cache::Data_t ;
+    using Tag = typename Entity::status_account_tag ;
+    const interactive::OrderStatus open[] = { interactive::OrderStatus::CREATED, interactive::OrderStatus::SUBMITTED,
+                                              interactive::OrderStatus::PENDING, interactive::OrderStatus::PARTIAL_FILL } ;
+    using Key = boost::tuple<interactive::OrderStatus, typename Entity::char_string> ;
+    return cache.template retrieve_many_with<Tag>(entries, [&](const typename Cache::key_maker_t &key) {
+        auto account_key = key(account) ;
+        std::vector<Key> keys ;
+        for ( interactive::OrderStatus status : open ) {
+            keys.push_back(boost::make_tuple(status, account_key)) ;
+        }
+        return keys ;
+    }) ;
+}
     
 }}
  
@@ -0,0 +1,105 @@
+/*
+ * File:   order_ids.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 1:20 PM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __INTERACTIVE_ORDER_IDS_HPP__
+#define __INTERACTIVE_ORDER_IDS_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+namespace interactive {
+
+/*
+ * Block of order ids reserved ahead of the orders that use them.
+ * The gateway only hands out the next valid id , every id above it is free for this
+ * client , so nextValidId opens a block of block ids from there and take() counts
+ * through it locally. Once low_watermark or fewer are left one reqIds is due and
+ * its answer extends the block , a burst only waits for the gateway when it uses up
+ * a whole block before the refill arrives.
+ * Dispatcher thread only , nextValidId and the orders both run there.
+ */
+class order_ids {
+public:
+    static const std::size_t BLOCK = 256 ;
+
+    explicit order_ids(std::size_t block = BLOCK) :
+        _next(0), _end(0), _block(0), _low_watermark(0), _requested(false) {
+        resize(block) ;
+    }
+
+    void resize(std::size_t block) {
+        if ( !block ) {
+            throw std::invalid_argument("order_ids block can not be empty") ;
+        }
+        _block = static_cast<long>(block) ;
+        _low_watermark = std::max(1L, _block / 4) ;
+    }
+
+    // nextValidId , ids below next are taken , ours or another session's
+    void refill(long next) {
+        _next = std::max(_next, next) ;
+        _end = std::max(_end, _next + _block) ;
+        _requested = false ;
+    }
+
+    // reconnect , a reqIds sent on the old socket will not be answered
+    void reset() {
+        _requested = false ;
+    }
+
+    bool available() const {
+        return _next < _end ;
+    }
+
+    long take() {
+        if ( !available() ) {
+            throw std::logic_error("order_ids block is exhausted") ;
+        }
+        return _next++ ;
+    }
+
+    // true once per refill , when the block runs low and reqIds should be sent
+    bool wants_refill() {
+        if ( _requested || _end - _next > _low_watermark ) {
+            return false ;
+        }
+        _requested = true ;
+        return true ;
+    }
+
+    std::size_t left() const {
+        return static_cast<std::size_t>(_end - _next) ;
+    }
+
+    std::size_t block() const {
+        return static_cast<std::size_t>(_block) ;
+    }
+
+private:
+    long _next ;
+    long _end ;
+    long _block ;
+    long _low_watermark ;
+    bool _requested ;
+};
+
+}
+
+#endif /* __INTERACTIVE_ORDER_IDS_HPP__ */
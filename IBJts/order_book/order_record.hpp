@@ -0,0 +1,263 @@
+/*
+ * File:   order_record.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 17, 2026, 11:05 PM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __IPC_DATA_ORDER_RECORD_HPP__
+#define __IPC_DATA_ORDER_RECORD_HPP__
+
+#include "interactive.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+namespace ipc { namespace data {
+
+/*
+ * Blob format header , boost binary archives start with the length of
+ * "serialization::archive" so they never match MAGIC.
+ */
+struct record_header {
+    static const std::uint32_t MAGIC = 0x4345524F ; // "OREC"
+    std::uint32_t magic ;
+    std::uint16_t version ;
+    std::uint16_t size ;
+};
+
+/*
+ * Flat fixed layout image of interactive::OrderContract , memcpy'd in and out of
+ * the segment. Strings that do not fit their field make the encoder fall back
+ * to the archive format , so nothing is ever truncated.
+ * The response section has a fixed offset and can be patched in place.
+ * Bump VERSION and keep decoding the previous layouts when fields change , new
+ * fields go at the end so an older record is a prefix of the current one.
+ * Version 1 ends before enqueued_at.
+ */
+struct order_record {
+    static const std::uint16_t VERSION = 2 ;
+
+    struct response_section {
+        double avg_fill_price ;
+        double last_fill_price ;
+        std::int32_t filled ;
+        std::int32_t remaining ;
+        std::int32_t perm_id ;
+        std::int32_t parent_id ;
+        std::int32_t client_id ;
+        char status[20] ;
+        char why_held[32] ;
+    };
+
+    record_header header ;
+    std::int64_t order_id ;
+    std::int64_t total_quantity ;
+    double lmt_price ;
+    std::int32_t client_id ;
+    std::int8_t cmd ;
+    char account[32] ;
+    char action[8] ;
+    char order_type[8] ;
+    char symbol[16] ;
+    char sec_type[8] ;
+    char exchange[16] ;
+    char currency[8] ;
+    response_section response ;
+    std::int64_t enqueued_at ;
+};
+
+static_assert(std::is_pod<order_record>::value, "order_record must stay memcpy-able");
+
+namespace record {
+
+    template<std::size_t N>
+    bool put(char (&field)[N], const std::string &value) {
+        if ( value.size() >= N ) {
+            return false ;
+        }
+        std::memcpy(field, value.data(), value.size()) ;
+        return true ;
+    }
+
+    template<std::size_t N>
+    std::string get(const char (&field)[N]) {
+        return std::string(field, ::strnlen(field, N)) ;
+    }
+
+    inline bool encode(const interactive::OrderResponse &r, order_record::response_section &section) {
+        section = order_record::response_section() ;
+        section.avg_fill_price = r.avgFillPrice ;
+        section.last_fill_price = r.lastFillPrice ;
+        section.filled = r.filled ;
+        section.remaining = r.remaining ;
+        section.perm_id = r.permId ;
+        section.parent_id = r.parentId ;
+        section.client_id = r.clientId ;
+        return put(section.status, r.status) && put(section.why_held, r.whyHeld) ;
+    }
+
+    inline void decode(const order_record::response_section &section, interactive::OrderResponse &r) {
+        r.avgFillPrice = section.avg_fill_price ;
+        r.lastFillPrice = section.last_fill_price ;
+        r.filled = section.filled ;
+        r.remaining = section.remaining ;
+        r.permId = section.perm_id ;
+        r.parentId = section.parent_id ;
+        r.clientId = section.client_id ;
+        r.status = get(section.status) ;
+        r.whyHeld = get(section.why_held) ;
+    }
+
+    inline bool encode(const interactive::OrderContract &data, order_record &r) {
+        r = order_record() ;
+        r.header.magic = record_header::MAGIC ;
+        r.header.version = order_record::VERSION ;
+        r.header.size = sizeof(order_record) ;
+        r.order_id = data.order_id ;
+        r.total_quantity = data.order.totalQuantity ;
+        r.lmt_price = data.order.lmtPrice ;
+        r.client_id = data.order.clientId ;
+        r.cmd = static_cast<std::int8_t>(data.cmd) ;
+        r.enqueued_at = data.enqueued_at ;
+        return put(r.account, data.order.account)      &&
+               put(r.action, data.order.action)        &&
+               put(r.order_type, data.order.orderType) &&
+               put(r.symbol, data.contract.symbol)     &&
+               put(r.sec_type, data.contract.secType)  &&
+               put(r.exchange, data.contract.exchange) &&
+               put(r.currency, data.contract.currency) &&
+               encode(data.response, r.response) ;
+    }
+
+    inline void decode(const order_record &r, interactive::OrderContract &data) {
+        data.cmd = static_cast<interactive::OrderInstruction>(r.cmd) ;
+        data.order.orderId = r.order_id ;
+        data.order.totalQuantity = r.total_quantity ;
+        data.order.lmtPrice = r.lmt_price ;
+        data.order.clientId = r.client_id ;
+        data.order.account = get(r.account) ;
+        data.order.action = get(r.action) ;
+        data.order.orderType = get(r.order_type) ;
+        data.contract.symbol = get(r.symbol) ;
+        data.contract.secType = get(r.sec_type) ;
+        data.contract.exchange = get(r.exchange) ;
+        data.contract.currency = get(r.currency) ;
+        decode(r.response, data.response) ;
+        data.enqueued_at = r.enqueued_at ;
+        data.account  = data.order.account ;
+        data.ticker   = data.contract.symbol ;
+        data.order_id = data.order.orderId ;
+    }
+
+    // nullptr when the blob is not a flat record (e.g. an archive written before the flat format)
+    inline const record_header * header_of(const char *blob, std::size_t size) {
+        if ( size < sizeof(record_header) ) {
+            return nullptr ;
+        }
+        const record_header *header = reinterpret_cast<const record_header *>(blob) ;
+        return header->magic == record_header::MAGIC ? header : nullptr ;
+    }
+
+    // bytes of the record a version wrote , 0 for a version we can not read
+    inline std::size_t size_of(std::uint16_t version) {
+        switch ( version ) {
+            case 1 :
+                return offsetof(order_record, enqueued_at) ;
+            case order_record::VERSION :
+                return sizeof(order_record) ;
+            default :
+                return 0 ;
+        }
+    }
+}
+
+/*
+ * How order_entity turns a Serializable into its blob and back ,
+ * boost binary archive unless there is a specialization.
+ */
+template<typename Serializable>
+struct blob_codec {
+    template<typename String>
+    static void store(const Serializable &data, String &blob) {
+        std::string blob_str = archive(data) ;
+        blob.assign(blob_str.data(), blob_str.data() + blob_str.length()) ;
+    }
+    static void load(const char *blob, std::size_t size, Serializable &data) {
+        std::stringstream ss (std::string(blob, size));
+        boost::archive::binary_iarchive iarch(ss);
+        iarch >> data;
+    }
+    static std::size_t size(const Serializable &data) {
+        return archive(data).size() ;
+    }
+    static std::string archive(const Serializable &data) {
+        std::stringstream ss;
+        boost::archive::binary_oarchive oarch(ss);
+        oarch << data ;
+        return ss.str() ;
+    }
+};
+
+template<>
+struct blob_codec<interactive::OrderContract> {
+    template<typename String>
+    static void store(const interactive::OrderContract &data, String &blob) {
+        order_record r ;
+        if ( record::encode(data, r) ) {
+            const char *bytes = reinterpret_cast<const char *>(&r) ;
+            blob.assign(bytes, bytes + sizeof(r)) ;
+        } else {
+            std::string blob_str = archive(data) ;
+            blob.assign(blob_str.data(), blob_str.data() + blob_str.length()) ;
+        }
+    }
+    static void load(const char *blob, std::size_t size, interactive::OrderContract &data) {
+        const record_header *header = record::header_of(blob, size) ;
+        if ( !header ) {
+            std::stringstream ss (std::string(blob, size));
+            boost::archive::binary_iarchive iarch(ss);
+            iarch >> data;
+            return ;
+        }
+        std::size_t record_size = record::size_of(header->version) ;
+        if ( !record_size || size != record_size ) {
+            throw std::runtime_error("unsupported order_record version " + std::to_string(header->version)) ;
+        }
+        order_record r = order_record() ; // fields newer than the blob stay zero
+        std::memcpy(&r, blob, record_size) ;
+        record::decode(r, data) ;
+    }
+    static std::size_t size(const interactive::OrderContract &data) {
+        order_record r ;
+        return record::encode(data, r) ? sizeof(r) : archive(data).size() ;
+    }
+    static std::string archive(const interactive::OrderContract &data) {
+        std::stringstream ss;
+        boost::archive::binary_oarchive oarch(ss);
+        oarch << data ;
+        return ss.str() ;
+    }
+};
+
+}}
+
+#endif /* __IPC_DATA_ORDER_RECORD_HPP__ */
@@ -22,14 +22,26 @@
 
 #include "order_entity.hpp"
 #include "entity_cache.hpp"
+#include "journal.hpp"
+#include "order_archive.hpp"
+#include "write_behind.hpp"
+#include "event_poller.hpp"
+#include "latency_trace.hpp"
+#include "order_ids.hpp"
+#include "batching_socket.hpp"
 #include "interactive.hpp"
 #include <EWrapper.h>
-#include <EPosixClientSocket.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <future>
 #include <string>
-#include <list>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
 #include <boost/optional.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
@@ -48,10 +60,21 @@ class OrderBook : protected EWrapper {
     using Alloc = typename Cache::char_allocator ;
 public:
     OrderBook(const std::string &cname, const std::function<boost::optional<OrderContract>()> queue) : 
-        client_{new EPosixClientSocket(this)}, queue_{queue}, cache_{cname}, next_order_ids_{}
+        client_{new batching_socket(this)}, queue_{queue}, order_ids_{}, cache_{cname, cache_growth()},
+        inbox_{INBOX_SIZE}
     {}
     OrderBook(const OrderBook& orig) = delete ;
-    virtual ~OrderBook() {disconnect();}
+    virtual ~OrderBook() {
+        disconnect();
+        // the dispatcher and feeder use every member , they have to be gone first
+        if ( dispatcher_.valid() ) {
+            dispatcher_.wait() ;
+        }
+        if ( feeder_.joinable() ) {
+            feeding_ = false ;
+            feeder_.join() ;
+        }
+    }
     bool connect(const std::string &host, unsigned int port, int client_id = 0) {
          // trying to connect
         LOG(info) << "OrderClient::connect connecting to " <<  host <<  ":" << port << " client_id=" << client_id ;
@@ -60,11 +83,27 @@ public:
              printf( "Cannot connect to %s:%d clientId:%d\n", host.c_str(), port, client_id);
              return is_success ;
         }
+        poller_.forget() ;
+        order_ids_.reset() ;
+        feeding_ = true ;
+        feeder_ = std::thread([this]() { feed(); }) ;
 
+        next_checkpoint_ = std::chrono::steady_clock::now() + checkpoint_interval_ ;
+        next_eviction_ = std::chrono::steady_clock::now() + eviction_interval() ;
+        next_trace_ = std::chrono::steady_clock::now() + trace_interval_ ;
+        writer_.reset(new datacache::write_behind<cache_write>(
+            [this](std::vector<cache_write> &batch) { apply(batch); },
+            [this]() { housekeeping(); })) ;
         dispatcher_ = std::async(std::launch::async, [this]() {
             while(isConnected()) {
                 dispatch_messages();
             }
+            feeding_ = false ;
+            feeder_.join() ;
+            writer_.reset() ; // applies what is still queued
+            if ( checkpoint_interval_.count() ) {
+                checkpoint() ; // last consistent state before shutdown
+            }
         });
 
         printf("Connected to %s:%d clientId:%d\n", host.c_str(), port, client_id);
@@ -75,10 +114,46 @@ public:
     }
     void disconnect() const {
 	client_->eDisconnect();
+        poller_.notify() ; // the dispatcher sees it right away
     }
     bool isConnected() const {
 	return client_->isConnected();
     }
+    // snapshot the cache every interval from the dispatcher thread , zero turns it off
+    void checkpoint_every(std::chrono::seconds interval) {
+        checkpoint_interval_ = interval ;
+    }
+    // journal every cache mutation to path , fsync'ed in groups off the dispatcher thread
+    void journal_to(const std::string &path) {
+        journal_.reset(new datacache::journal(path)) ;
+        cache_.journal_to(journal_.get()) ;
+    }
+    // move FILLED and CANCELLED orders older than age out of the cache into an append-only archive
+    void retain(std::chrono::seconds age, const std::string &archive_path) {
+        retention_ = age ;
+        archive_.reset(new ipc::data::order_archive(archive_path)) ;
+    }
+    // order ids reserved per reqIds , a refill is requested when a quarter of them is left
+    void reserve_order_ids(std::size_t block) {
+        order_ids_.resize(block) ;
+    }
+    // most orders encoded into one socket write , cork holds the socket while they are encoded
+    void dispatch_batch(std::size_t orders, bool cork = false) {
+        dispatch_batch_ = std::max<std::size_t>(orders, 1) ;
+        client_->cork(cork) ;
+    }
+    // log the order latency histograms every interval , zero turns it off
+    void trace_every(std::chrono::seconds interval) {
+        trace_interval_ = interval ;
+    }
+    // latency of every stage an order went through so far , any thread
+    void dump_latency(std::ostream &out) const {
+        trace_.dump(out) ;
+    }
+    // restore the cache from its last snapshot , call before constructing the book
+    static bool recover(const std::string &cname) {
+        return Cache::recover(cname) ;
+    }
     
 protected:    
     // events from EWrapper
@@ -94,26 +169,23 @@ protected:
     void orderStatus(OrderId orderId, const IBString &status, int filled,
             int remaining, double avgFillPrice, int permId, int parentId,
             double lastFillPrice, int clientId, const IBString& whyHeld) {
-        
+        trace_.acknowledged(orderId, monotonic_ns()) ;
         OrderResponse r;
         r.status=status;
         r.filled = filled;
         r.remaining = remaining;
         r.avgFillPrice = avgFillPrice ;
         r.permId = permId;
+        r.parentId = parentId;
         r.lastFillPrice = lastFillPrice;
         r.clientId = clientId;
         r.whyHeld = whyHeld;
-        //Unfortunately we don't have enough to reconstruct OrderContract so lookup is needed
-        std::vector<std::shared_ptr<OrderContract>> orders;
-        using Tag = typename ipc::data::order_entity<Alloc>::order_tag ;
-        if ( !cache_.template retrieve<Tag>(orders, orderId) ) {
-            return;   
-        }
-        auto valuep = orders.at(0) ;
-        valuep->add_response(r) ;
-        cache_.template update<Tag>(*valuep , orderId ) ;
-        std::cout << "TODO:  Order: id" << orderId << ", status=" << status ;
+        //patched into the cached order by the writer thread , see apply
+        cache_write w ;
+        w.order_id = orderId ;
+        w.response = r ;
+        writer_->push(w) ;
+        LOG(debug) << "Order: id=" << orderId << ", status=" << status ;
     }
     void openOrder(OrderId orderId, const Contract& contract, const Order& order, const OrderState& state) {
         //TODO: order_book_cache.update(orderId , OrderContract(order, contact)) ;
@@ -131,8 +203,8 @@ protected:
     void updateAccountTime(const IBString& timeStamp) {}
     void accountDownloadEnd(const IBString& accountName) {}
     void nextValidId(OrderId order_id) {
-        LOG(info) << "nextValidId=" << order_id << ", call back from API , forward to queue" ;
-	next_order_ids_.push_back(order_id);
+        order_ids_.refill(order_id) ;
+        LOG(info) << "nextValidId=" << order_id << ", " << order_ids_.left() << " order ids reserved" ;
     }
     void contractDetails(int reqId, const ContractDetails& contractDetails) {}
     void bondContractDetails(int reqId, const ContractDetails& contractDetails) {}
@@ -175,106 +247,253 @@ protected:
     void displayGroupList( int reqId, const IBString& groups) {}
     void displayGroupUpdated( int reqId, const IBString& contractInfo) {}
 private:
-    void dispatch_messages()  {
-        if ( !next_order_ids_.empty()) {
-            dispatch_order() ;
+    // cache mutation queued by the dispatcher thread for the writer thread
+    struct cache_write {
+        OrderId order_id {} ;
+        bool is_insert {} ;
+        OrderContract order {} ; // insert
+        OrderResponse response {} ; // otherwise
+    };
+    // grow the order cache from a helper thread so order acks never wait for a remap
+    static mpclmi::ipc::growth_policy cache_growth() {
+        mpclmi::ipc::growth_policy policy ;
+        policy.low_watermark = 0.25 ;
+        policy.growth_factor = 2.0 ;
+        policy.background = true ;
+        return policy ;
+    }
+    std::chrono::seconds eviction_interval() const {
+        return std::max(std::chrono::seconds(1), retention_ / 10) ;
+    }
+    void evict() {
+        try {
+            std::size_t n = ipc::data::evict_terminal(cache_, *archive_, retention_) ;
+            if ( n ) {
+                LOG(info) << "OrderBook::evict archived " << n << " terminal orders to " << archive_->path() ;
+            }
+        } catch (const std::exception &e) {
+            LOG(error) << "OrderBook::evict " << e.what() ;
         }
-        fd_set readSet, writeSet, errorSet;
-	struct timeval tval;
-	tval.tv_usec = 500000; //TODO: pass it into dispatch_messages
-	tval.tv_sec = 0;
-	
-	if( client_->fd() < 0 ) {
-            return;
+    }
+    void checkpoint() {
+        if ( !cache_.checkpoint() ) {
+            LOG(error) << "OrderBook::checkpoint failed to snapshot order cache" ;
         }
-        
-        FD_ZERO( &readSet);
-        errorSet = writeSet = readSet;
-
-        FD_SET( client_->fd(), &readSet);
-
-        if( !client_->isOutBufferEmpty())
-                FD_SET( client_->fd(), &writeSet);
-
-        FD_SET( client_->fd(), &errorSet);
-
-        int ret = select( client_->fd() + 1, &readSet, &writeSet, &errorSet, &tval);
-
-        if( ret == 0) { // timeout
+    }
+    // writer thread , eviction and checkpoints take the cache lock so they stay off the dispatcher too
+    void housekeeping() {
+        auto now = std::chrono::steady_clock::now() ;
+        if ( archive_ && now >= next_eviction_ ) {
+            evict() ;
+            next_eviction_ = std::chrono::steady_clock::now() + eviction_interval() ;
+        }
+        if ( checkpoint_interval_.count() && now >= next_checkpoint_ ) {
+            checkpoint() ;
+            next_checkpoint_ = std::chrono::steady_clock::now() + checkpoint_interval_ ;
+        }
+        if ( trace_interval_.count() && now >= next_trace_ ) {
+            std::ostringstream out ;
+            trace_.dump(out) ;
+            LOG(info) << "OrderBook order latency\n" << out.str() ;
+            next_trace_ = now + trace_interval_ ;
+        }
+    }
+    /*
+     * Writer thread , a batch is applied in push order as runs of inserts and runs of
+     * responses , each run under one exclusive section , so every order sees its insert
+     * and responses in the order the dispatcher saw them.
+     */
+    void apply(std::vector<cache_write> &batch) {
+        std::vector<OrderContract> inserts ;
+        std::vector<std::pair<long, OrderResponse>> responses ;
+        for ( cache_write &w : batch ) {
+            if ( w.is_insert ) {
+                apply_responses(responses) ;
+                inserts.push_back(std::move(w.order)) ;
+            } else {
+                apply_inserts(inserts) ;
+                responses.emplace_back(w.order_id, std::move(w.response)) ;
+            }
+        }
+        apply_inserts(inserts) ;
+        apply_responses(responses) ;
+    }
+    void apply_inserts(std::vector<OrderContract> &inserts) {
+        if ( !inserts.empty() && !cache_.insert(inserts) ) {
+            LOG(error) << "OrderBook failed to insert orders in cache , first order:" << inserts.front().order_id ;
+        }
+        inserts.clear() ;
+    }
+    void apply_responses(std::vector<std::pair<long, OrderResponse>> &responses) {
+        using Tag = typename ipc::data::order_entity<Alloc>::order_tag ;
+        using Entity = typename Cache::Data_t ;
+        if ( responses.empty() ) {
+            return ;
+        }
+        //patch the response of the cached order in place , no need to reconstruct OrderContract
+        std::size_t n = cache_.template modify_batch<Tag>(responses, [](Entity &entity, const OrderResponse &r) {
+            entity.add_response(r);
+        }) ;
+        if ( n != responses.size() ) {
+            LOG(debug) << "OrderBook " << responses.size() - n << " responses for orders not in cache" ;
+        }
+        responses.clear() ;
+    }
+    /*
+     * Dispatcher thread , queued orders go out first , then it sleeps until the socket
+     * has something or the feeder queues another order. The timeout only bounds how
+     * long a lost wakeup could go unnoticed.
+     */
+    void dispatch_messages()  {
+        bool more = dispatch_orders() ;
+	if( client_->fd() < 0 ) {
             return;
         }
+        // a full batch went out , only poll the socket before the next one
+        unsigned events = poller_.wait(client_->fd(), client_->pending(), more ? 0 : POLL_TIMEOUT_MS) ;
 
-        if( ret < 0) {	// error
+        if( events & event_poller::failed ) {
                 disconnect();
                 return;
         }
 
-        if( client_->fd() < 0)
-                return;
-
-        if( FD_ISSET( client_->fd(), &errorSet)) {
+        if( client_->fd() >= 0 && (events & event_poller::error) ) {
                 // error on socket
                 client_->onError();
         }
 
-        if( client_->fd() < 0)
-                return;
-
-        if( FD_ISSET( client_->fd(), &writeSet)) {
+        if( client_->fd() >= 0 && (events & event_poller::writable) ) {
                 // socket is ready for writing
-                client_->onSend();
+                client_->on_writable();
         }
 
-        if( client_->fd() < 0)
-                return;
-
-        if( FD_ISSET( client_->fd(), &readSet)) {
+        if( client_->fd() >= 0 && (events & event_poller::readable) ) {
                 // socket is ready for reading
                 client_->onReceive();
         }
-	
     }
-    void dispatch_order() {
-        //should  not  block here see queue timeout
-        auto opt = queue_() ;
-        if ( !opt ) {
-            LOG(debug) << "Queue is empty return!" ;
-            return ;
+    // feeder thread , blocks on the order queue so the dispatcher never does
+    void feed() {
+        while ( feeding_ ) {
+            boost::optional<OrderContract> opt ;
+            try {
+                opt = queue_() ;
+            } catch (const std::exception &e) {
+                LOG(error) << "OrderBook::feed " << e.what() ;
+                std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT_MS)) ;
+                continue ;
+            }
+            if ( !opt ) {
+                continue ;
+            }
+            inbound in {std::move(*opt), monotonic_ns()} ;
+            // full while the dispatcher waits for order ids , that takes a gateway round trip
+            while ( !inbox_.push(in) && feeding_ ) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(INBOX_BACKOFF_MS)) ;
+            }
+            poller_.notify() ;
+        }
+    }
+    /*
+     * Up to dispatch_batch_ orders are encoded back to back into the socket buffer and
+     * written with one send , returns true when more are ready to go.
+     * Orders to place stay queued in the inbox , in order , until nextValidId refills the ids.
+     */
+    bool dispatch_orders() {
+        std::size_t n {} ;
+        while ( n < dispatch_batch_ && ready() ) {
+            if ( !n++ ) {
+                client_->hold() ;
+            }
+            inbound &in = inbox_.front() ;
+            dispatch_order(in.order, in.dequeued_at) ;
+            inbox_.pop() ;
+        }
+        if ( isConnected() && order_ids_.wants_refill() ) {
+            client_->reqIds(static_cast<int>(order_ids_.block())) ;
+        }
+        if ( n ) {
+            client_->flush() ;
+            std::int64_t sent = monotonic_ns() ;
+            for ( const placed_order &p : placed_ ) {
+                trace_.placed(p.order_id, p.enqueued, p.dequeued, p.dispatched, sent) ;
+            }
+            placed_.clear() ;
         }
-        OrderContract value = *opt ;
+        return ready() ;
+    }
+    bool ready() const {
+        return inbox_.read_available() &&
+              (inbox_.front().order.cmd != OrderInstruction::PLACE || order_ids_.available()) ;
+    }
+    void dispatch_order(OrderContract &value, std::int64_t dequeued_at) {
         if ( !(value.cmd == OrderInstruction::PLACE || value.cmd == OrderInstruction::CANCEL)) {
             printf( "Bad Order [%d]: %s %ld %s at %f\n", (int)value.cmd, value.order.action.c_str(), value.order.totalQuantity, value.contract.symbol.c_str(), value.order.lmtPrice);
             return;
         }
-        OrderId next_order_id = next_order_ids_.front() ;
-        next_order_ids_.pop_front() ;
+        OrderId next_order_id = value.cmd == OrderInstruction::PLACE ? order_ids_.take() : value.order_id ;
         LOG(debug) << "Submitting Order " 
                    << next_order_id << ":" << value.order.action << " "
                    << value.order.totalQuantity << " "
                    << value.contract.symbol << "@" <<  value.order.lmtPrice ;
 	if ( value.cmd == OrderInstruction::PLACE) {
             value.assign_order(next_order_id) ;
-            if ( cache_.insert(value) ) {
-                client_->placeOrder(next_order_id, value.contract, value.order);
-            } else {
-              LOG(debug)  << "failed to insert order in cache:" << value.order_id;
-            }
+            // ids come from the gateway and are never reused , the insert can only fail
+            // for lack of memory which the writer logs , so the order goes out right away
+            cache_write w ;
+            w.order_id = next_order_id ;
+            w.is_insert = true ;
+            w.order = value ;
+            placed_.push_back(placed_order{next_order_id, value.enqueued_at, dequeued_at, monotonic_ns()}) ;
+            writer_->push(w) ;
+            client_->placeOrder(next_order_id, value.contract, value.order);
         } else if (value.cmd == OrderInstruction::CANCEL) {
              client_->cancelOrder(value.order_id);
         }
-
-        if ( next_order_ids_.empty()) {
-            client_->reqIds(1) ;
-        }
     }
-    std::unique_ptr<EPosixClientSocket> client_;
+    std::unique_ptr<batching_socket> client_;
     std::future<void> dispatcher_ {};
     std::function<boost::optional<OrderContract>()> queue_;
-    std::list<OrderId> next_order_ids_ {};
+    order_ids order_ids_ ;
+    std::unique_ptr<datacache::journal> journal_ ;
     Cache  cache_ ;
+    std::chrono::seconds checkpoint_interval_ {0};
+    std::chrono::seconds retention_ {0};
+    std::unique_ptr<ipc::data::order_archive> archive_ ;
+    std::chrono::steady_clock::time_point next_checkpoint_ {};
+    std::chrono::steady_clock::time_point next_eviction_ {};
+    std::chrono::seconds trace_interval_ {0};
+    std::chrono::steady_clock::time_point next_trace_ {};
+    order_trace trace_ ;
+    struct placed_order {
+        long order_id ;
+        std::int64_t enqueued ;
+        std::int64_t dequeued ;
+        std::int64_t dispatched ;
+    };
+    std::vector<placed_order> placed_ ; // orders of the batch in flight , traced once it is written
+    std::size_t dispatch_batch_ {DISPATCH_BATCH};
+    static const std::size_t INBOX_SIZE = 1024 ;
+    static const int INBOX_BACKOFF_MS = 1 ;
+    static const std::size_t DISPATCH_BATCH = 64 ;
+    static const int POLL_TIMEOUT_MS = 500 ;
+    struct inbound {
+        OrderContract order ;
+        std::int64_t dequeued_at ; // monotonic_ns() when the feeder took it off the queue
+    };
+    boost::lockfree::spsc_queue<inbound> inbox_ ; // feeder -> dispatcher
+    event_poller poller_ ;
+    std::atomic<bool> feeding_ {false};
+    std::thread feeder_ ;
+    std::unique_ptr<datacache::write_behind<cache_write>> writer_ ; // after everything it uses , drains into the cache before it goes
     time_t sleep_deadline;
 };
 
+// odr-used , std::chrono::milliseconds takes its count by reference
+template<typename Memory> const std::size_t OrderBook<Memory>::INBOX_SIZE ;
+template<typename Memory> const int OrderBook<Memory>::INBOX_BACKOFF_MS ;
+template<typename Memory> const int OrderBook<Memory>::POLL_TIMEOUT_MS ;
+
 } //namespace
 #endif	/* ORDERCLIENT_HPP */
 
@@ -38,6 +38,33 @@ using namespace boost::interprocess;
 boost::optional<OrderContract>  fetch_order() ;
 extern void init_framework_logging(const std::string&);
 
+template<typename Memory>
+void run_book(const std::string &host, int port, bool warm, int checkpoint_sec, const std::string &journal_path,
+              int retain_sec, const std::string &archive_path, int latency_sec, int batch, bool cork) {
+    const std::string cache_name = "order_book_cache" ;
+    if ( warm ) {
+        interactive::OrderBook<Memory>::recover(cache_name) ;
+    }
+    //Create live book object conencted to IB Gateway
+    interactive::OrderBook<Memory> book(cache_name, [](){
+        return fetch_order() ;
+    });
+    book.checkpoint_every(std::chrono::seconds(checkpoint_sec)) ;
+    if ( !journal_path.empty() ) {
+        book.journal_to(journal_path) ;
+    }
+    if ( retain_sec > 0 ) {
+        book.retain(std::chrono::seconds(retain_sec), archive_path) ;
+    }
+    book.trace_every(std::chrono::seconds(latency_sec)) ;
+    book.dispatch_batch(batch, cork) ;
+
+	if (book.connect(host, port)) { //will start a single thread dispatcher inside the book
+		book.run(); // will wait for dispatcher thread to terminate 
+		book.dump_latency(std::clog) ;
+	}
+}
+
 int main(int argc, char **argv) {
        
     bool success = false;
@@ -47,11 +74,25 @@ int main(int argc, char **argv) {
     std::string host;
     int port ;
     int reconnect_n;
+    int checkpoint_sec;
+    std::string journal_path;
+    int retain_sec;
+    std::string archive_path;
+    int latency_sec;
+    int batch;
     desc.add_options()
             ("help,h", "display help screen")
             ("attempts,N",  po::value<int>(&reconnect_n), "specify number of attempts to reconnect before giving up")
             ("host,H",  po::value<std::string>(&host) , "specify host")
-            ("port,P",  po::value<int>(&port), "specify port numer");
+            ("port,P",  po::value<int>(&port), "specify port numer")
+            ("warm,w", "keep order cache in a mapped file and restore it from the last snapshot on start")
+            ("checkpoint,C",  po::value<int>(&checkpoint_sec)->default_value(30), "seconds between cache snapshots with --warm , 0 disables")
+            ("journal,J",  po::value<std::string>(&journal_path), "append every order cache mutation to this write-ahead journal")
+            ("retain,R",  po::value<int>(&retain_sec)->default_value(0), "seconds filled and cancelled orders stay in the cache , 0 keeps them forever")
+            ("archive,A",  po::value<std::string>(&archive_path)->default_value("/tmp/order_book.archive"), "file evicted orders are appended to")
+            ("latency,L",  po::value<int>(&latency_sec)->default_value(0), "seconds between order latency histograms in the log , 0 only prints them on exit")
+            ("batch,B",  po::value<int>(&batch)->default_value(64), "most queued orders written to the gateway with one send")
+            ("cork", "hold the gateway socket with TCP_CORK while a batch of orders is encoded");
  
     try {
         po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -82,14 +123,11 @@ int main(int argc, char **argv) {
     ,512                      //max message size
     );
 
-    //Create live book object conencted to IB Gateway
-    interactive::OrderBook<mpclmi::ipc::Shared> book("order_book_cache", [](){
-        return fetch_order() ;
-    });
-    
-	if (book.connect(host, port)) { //will start a single thread dispatcher inside the book
-		book.run(); // will wait for dispatcher thread to terminate 
-	}
+    if ( vm.count("warm") ) {
+        run_book<mpclmi::ipc::Mapped>(host, port, true, checkpoint_sec, journal_path, retain_sec, archive_path, latency_sec, batch, vm.count("cork") > 0) ;
+    } else {
+        run_book<mpclmi::ipc::Shared>(host, port, false, 0, journal_path, retain_sec, archive_path, latency_sec, batch, vm.count("cork") > 0) ;
+    }
 
 }
  
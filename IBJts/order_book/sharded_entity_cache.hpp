@@ -0,0 +1,276 @@
+/*
+ * File:   sharded_entity_cache.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 17, 2026, 10:15 PM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __DATACACHE_SHARDED_ENTITY_CACHE_HPP__
+#define __DATACACHE_SHARDED_ENTITY_CACHE_HPP__
+
+#include "entity_cache.hpp"
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace datacache {
+
+/*
+ * Partitions entities by hash of Data_t::primary_key into Shards independent
+ * entity_cache instances , each with its own segment "<name>_shard<N>" and named mutex,
+ * so writers of different keys do not queue on one lock.
+ * Lookups by Data_t::primary_tag go to a single shard , every other tag fans out
+ * across all shards and the results are concatenated in shard order.
+ * Like entity_cache an instance is meant to be used by one thread.
+ */
+template<typename Memory, template <class> class Container, std::size_t Shards = 8>
+class sharded_entity_cache
+{
+public:
+    using shard_t = entity_cache<Memory, Container> ;
+    using char_allocator = typename shard_t::char_allocator ;
+    using char_string = typename shard_t::char_string ;
+    using Data_t = typename shard_t::Data_t ;
+    using key_maker_t = typename shard_t::key_maker_t ;
+    using primary_tag = typename Data_t::primary_tag ;
+    using primary_key_t = typename std::decay<decltype(Data_t::primary_key(std::declval<const Data_t &>()))>::type ;
+
+    static_assert(Shards > 0, "sharded_entity_cache needs at least one shard");
+
+    sharded_entity_cache(const std::string &name,
+                         const mpclmi::ipc::growth_policy &growth = mpclmi::ipc::growth_policy()) : _shards() {
+        for ( std::size_t i = 0 ; i < Shards ; ++i ) {
+            _shards[i].reset(new shard_t(name + "_shard" + std::to_string(i), growth)) ;
+        }
+    }
+
+    void clear() {
+        for ( auto &shard : _shards ) {
+            shard->clear() ;
+        }
+    }
+
+    template<typename Serializable>
+    bool insert( const Serializable &data) {
+        return shard(Data_t::primary_key(data)).insert(data) ;
+    }
+
+    template<typename Serializable>
+    bool insert( const std::vector<Serializable> &data) {
+        std::array<std::vector<Serializable>, Shards> partitions ;
+        for ( const auto &item : data) {
+            partitions[shard_index(Data_t::primary_key(item))].push_back(item) ;
+        }
+        bool is_success {true} ;
+        for ( std::size_t i = 0 ; i < Shards ; ++i ) {
+            if ( !partitions[i].empty() ) {
+                is_success &= _shards[i]->insert(partitions[i]) ;
+            }
+        }
+        return is_success ;
+    }
+
+    template<typename Tag, typename Serializable, typename Arg>
+    bool update( const Serializable &data, Arg&& arg) {
+        return update_by<Tag>(is_primary<Tag>(), data, std::forward<Arg>(arg)) ;
+    }
+
+    template<typename Tag, typename Serializable, typename ...Args>
+    bool update( const Serializable &data, Args&& ...args) {
+        bool is_success {false} ;
+        for ( auto &shard : _shards ) {
+            is_success |= shard->template update<Tag>(data, args...) ;
+        }
+        return is_success ;
+    }
+
+    template<typename Tag, typename Serializable, typename Arg>
+    bool retrieve(std::vector<std::shared_ptr<Serializable>> &entries, Arg && arg) {
+        return retrieve_by<Tag>(is_primary<Tag>(), entries, std::forward<Arg>(arg)) ;
+    }
+
+    template<typename Tag, typename Serializable, typename ...Args>
+    bool retrieve(std::vector<std::shared_ptr<Serializable>> &entries, Args&& ...args) {
+        for ( auto &shard : _shards ) {
+            shard->template retrieve<Tag>(entries, args...) ;
+        }
+        return !entries.empty() ;
+    }
+
+    template<typename Serializable>
+    bool retrieve(std::vector<std::shared_ptr<Serializable>> &entries) {
+        for ( auto &shard : _shards ) {
+            shard->retrieve(entries) ;
+        }
+        return !entries.empty() ;
+    }
+
+    // one lock per shard , keys of the primary tag only go to the shard owning them
+    template<typename Tag, typename Serializable, typename Key>
+    std::size_t retrieve_many(std::vector<std::shared_ptr<Serializable>> &entries, const std::vector<Key> &keys) {
+        return retrieve_many_by<Tag>(is_primary<Tag>(), entries, keys) ;
+    }
+
+    // keys are built in every shard , they hold strings of its segment
+    template<typename Tag, typename Serializable, typename MakeKeys>
+    std::size_t retrieve_many_with(std::vector<std::shared_ptr<Serializable>> &entries, MakeKeys &&make_keys) {
+        std::size_t n {} ;
+        for ( auto &shard : _shards ) {
+            n += shard->template retrieve_many_with<Tag>(entries, make_keys) ;
+        }
+        return n ;
+    }
+
+    template<typename Tag, typename Arg, typename Fn>
+    std::size_t visit(Arg && arg, Fn && fn) {
+        return visit_by<Tag>(is_primary<Tag>(), std::forward<Arg>(arg), fn) ;
+    }
+
+    template<typename Fn>
+    std::size_t visit(Fn && fn) {
+        std::size_t n {} ;
+        for ( auto &shard : _shards ) {
+            n += shard->visit(fn) ;
+        }
+        return n ;
+    }
+
+    // chunked scan of one shard after the other , see entity_cache::scan
+    template<typename Serializable, typename Fn>
+    std::size_t scan(Fn && fn) {
+        std::size_t n {} ;
+        for ( auto &shard : _shards ) {
+            n += shard->template scan<Serializable>(fn) ;
+        }
+        return n ;
+    }
+
+    template<typename Tag, typename Arg, typename Pred>
+    std::size_t erase_if(Arg && arg, Pred && pred) {
+        return erase_by<Tag>(is_primary<Tag>(), std::forward<Arg>(arg), pred) ;
+    }
+
+    /*
+     * String keys do not belong to a shard , the key is always allocated in shard 0 and
+     * compares against the indexes of every shard. It is only valid for the current
+     * mapping of shard 0 , see entity_cache::create_ipc_key .
+     */
+    char_string create_ipc_key(const std::string &key)  const {
+        return _shards[0]->create_ipc_key(key) ;
+    }
+
+    // keys are converted to the type of Data_t::primary_key first , an int and a long of one order land together
+    template<typename Key>
+    static std::size_t shard_index(const Key &key) {
+        return std::hash<primary_key_t>()(static_cast<primary_key_t>(key)) % Shards ;
+    }
+
+private:
+    template<typename Tag>
+    using is_primary = std::is_same<Tag, primary_tag> ;
+
+    template<typename Key>
+    shard_t & shard(const Key &key) {
+        return *_shards[shard_index(key)] ;
+    }
+
+    template<typename Tag, typename Serializable, typename Arg>
+    bool update_by(std::true_type, const Serializable &data, Arg &&arg) {
+        return shard(arg).template update<Tag>(data, std::forward<Arg>(arg)) ;
+    }
+
+    template<typename Tag, typename Serializable, typename Arg>
+    bool update_by(std::false_type, const Serializable &data, Arg &&arg) {
+        bool is_success {false} ;
+        for ( auto &shard : _shards ) {
+            is_success |= shard->template update<Tag>(data, arg) ;
+        }
+        return is_success ;
+    }
+
+    template<typename Tag, typename Serializable, typename Arg>
+    bool retrieve_by(std::true_type, std::vector<std::shared_ptr<Serializable>> &entries, Arg &&arg) {
+        return shard(arg).template retrieve<Tag>(entries, std::forward<Arg>(arg)) ;
+    }
+
+    template<typename Tag, typename Serializable, typename Arg>
+    bool retrieve_by(std::false_type, std::vector<std::shared_ptr<Serializable>> &entries, Arg &&arg) {
+        for ( auto &shard : _shards ) {
+            shard->template retrieve<Tag>(entries, arg) ;
+        }
+        return !entries.empty() ;
+    }
+
+    template<typename Tag, typename Serializable, typename Key>
+    std::size_t retrieve_many_by(std::true_type, std::vector<std::shared_ptr<Serializable>> &entries, const std::vector<Key> &keys) {
+        std::array<std::vector<Key>, Shards> partitions ;
+        for ( const auto &key : keys ) {
+            partitions[shard_index(key)].push_back(key) ;
+        }
+        std::size_t n {} ;
+        for ( std::size_t i = 0 ; i < Shards ; ++i ) {
+            if ( !partitions[i].empty() ) {
+                n += _shards[i]->template retrieve_many<Tag>(entries, std::move(partitions[i])) ;
+            }
+        }
+        return n ;
+    }
+
+    template<typename Tag, typename Serializable, typename Key>
+    std::size_t retrieve_many_by(std::false_type, std::vector<std::shared_ptr<Serializable>> &entries, const std::vector<Key> &keys) {
+        std::size_t n {} ;
+        for ( auto &shard : _shards ) {
+            n += shard->template retrieve_many<Tag>(entries, keys) ;
+        }
+        return n ;
+    }
+
+    template<typename Tag, typename Arg, typename Fn>
+    std::size_t visit_by(std::true_type, Arg &&arg, Fn &fn) {
+        return shard(arg).template visit<Tag>(std::forward<Arg>(arg), fn) ;
+    }
+
+    template<typename Tag, typename Arg, typename Fn>
+    std::size_t visit_by(std::false_type, Arg &&arg, Fn &fn) {
+        std::size_t n {} ;
+        for ( auto &shard : _shards ) {
+            n += shard->template visit<Tag>(arg, fn) ;
+        }
+        return n ;
+    }
+
+    template<typename Tag, typename Arg, typename Pred>
+    std::size_t erase_by(std::true_type, Arg &&arg, Pred &pred) {
+        return shard(arg).template erase_if<Tag>(std::forward<Arg>(arg), pred) ;
+    }
+
+    template<typename Tag, typename Arg, typename Pred>
+    std::size_t erase_by(std::false_type, Arg &&arg, Pred &pred) {
+        std::size_t n {} ;
+        for ( auto &shard : _shards ) {
+            n += shard->template erase_if<Tag>(arg, pred) ;
+        }
+        return n ;
+    }
+
+    std::array<std::unique_ptr<shard_t>, Shards> _shards ;
+};
+
+}
+
+#endif /* __DATACACHE_SHARDED_ENTITY_CACHE_HPP__ */
@@ -0,0 +1,169 @@
+/*
+ * File:   snapshot.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 12:10 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __DATACACHE_SNAPSHOT_HPP__
+#define __DATACACHE_SNAPSHOT_HPP__
+
+#include <cstdint>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/crc.hpp>
+
+#if defined ( _WIN32 )
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace datacache { namespace snapshot {
+
+/*
+ * Snapshot file is [header][segment image] , crc covers the image.
+ * It is written to "<path>.tmp" and renamed into place only once it is
+ * complete and synced , so a crash leaves either the old or the new snapshot.
+ */
+struct header {
+    static const std::uint32_t MAGIC = 0x50414E53 ; // "SNAP"
+    static const std::uint16_t VERSION = 1 ;
+    std::uint32_t magic ;
+    std::uint16_t version ;
+    std::uint16_t reserved ;
+    std::uint64_t size ;
+    std::uint64_t sequence ;
+    std::uint32_t crc ;
+    std::uint32_t reserved2 ;
+};
+
+using file_ptr = std::unique_ptr<std::FILE, int(*)(std::FILE*)> ;
+
+inline bool sync(std::FILE *file) {
+    if ( std::fflush(file) != 0 ) {
+        return false ;
+    }
+#if defined ( _WIN32 )
+    return ::_commit(::_fileno(file)) == 0 ;
+#else
+    return ::fsync(::fileno(file)) == 0 ;
+#endif
+}
+
+inline bool replace(const std::string &from, const std::string &to) {
+#if defined ( _WIN32 )
+    std::remove(to.c_str()) ;
+#endif
+    return std::rename(from.c_str(), to.c_str()) == 0 ;
+}
+
+// crc of size bytes starting at the current position
+inline bool crc_of(std::FILE *file, std::uint64_t size, std::uint32_t &crc) {
+    boost::crc_32_type result ;
+    std::vector<char> buf(1 << 20) ;
+    while ( size ) {
+        std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(size, buf.size())) ;
+        if ( std::fread(buf.data(), 1, n, file) != n ) {
+            return false ;
+        }
+        result.process_bytes(buf.data(), n) ;
+        size -= n ;
+    }
+    crc = result.checksum() ;
+    return true ;
+}
+
+/*
+ * copy() is meant to run while writers are locked out and only puts the image
+ * into the page cache , commit() does the checksum and the syncs afterwards.
+ */
+class writer {
+public:
+    explicit writer(const std::string &path) :
+        _path(path), _tmp_path(path + ".tmp"), _file(std::fopen(_tmp_path.c_str(), "w+b"), &std::fclose), _header() {}
+
+    bool copy(const void *address, std::uint64_t size, std::uint64_t sequence) {
+        if ( !_file ) {
+            return false ;
+        }
+        _header.magic = header::MAGIC ;
+        _header.version = header::VERSION ;
+        _header.size = size ;
+        _header.sequence = sequence ;
+        return std::fwrite(&_header, sizeof(_header), 1, _file.get()) == 1 &&
+               std::fwrite(address, 1, size, _file.get()) == size ;
+    }
+
+    bool commit() {
+        if ( !_file || std::fflush(_file.get()) != 0 || std::fseek(_file.get(), sizeof(_header), SEEK_SET) != 0 ) {
+            return false ;
+        }
+        if ( !crc_of(_file.get(), _header.size, _header.crc) || std::fseek(_file.get(), 0, SEEK_SET) != 0 ) {
+            return false ;
+        }
+        if ( std::fwrite(&_header, sizeof(_header), 1, _file.get()) != 1 || !sync(_file.get()) ) {
+            return false ;
+        }
+        _file.reset() ;
+        return replace(_tmp_path, _path) ;
+    }
+
+private:
+    std::string _path ;
+    std::string _tmp_path ;
+    file_ptr _file ;
+    header _header ;
+};
+
+/*
+ * Validates the snapshot at path and writes its image over store_path.
+ * Returns false , leaving store_path alone , when there is no valid snapshot.
+ */
+inline bool restore(const std::string &path, const std::string &store_path) {
+    file_ptr in(std::fopen(path.c_str(), "rb"), &std::fclose) ;
+    header h ;
+    std::uint32_t crc {} ;
+    if ( !in || std::fread(&h, sizeof(h), 1, in.get()) != 1 ||
+         h.magic != header::MAGIC || h.version != header::VERSION ||
+         !crc_of(in.get(), h.size, crc) || crc != h.crc ) {
+        return false ;
+    }
+    std::string tmp_path = store_path + ".tmp" ;
+    file_ptr out(std::fopen(tmp_path.c_str(), "wb"), &std::fclose) ;
+    if ( !out || std::fseek(in.get(), sizeof(h), SEEK_SET) != 0 ) {
+        return false ;
+    }
+    std::vector<char> buf(1 << 20) ;
+    for ( std::uint64_t size = h.size ; size ; ) {
+        std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(size, buf.size())) ;
+        if ( std::fread(buf.data(), 1, n, in.get()) != n || std::fwrite(buf.data(), 1, n, out.get()) != n ) {
+            return false ;
+        }
+        size -= n ;
+    }
+    if ( !sync(out.get()) ) {
+        return false ;
+    }
+    out.reset() ;
+    return replace(tmp_path, store_path) ;
+}
+
+}}
+
+#endif /* __DATACACHE_SNAPSHOT_HPP__ */
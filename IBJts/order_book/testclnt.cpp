@@ -84,6 +84,7 @@ int main(int argc, char **argv) {
 	order.lmtPrice = 0.01;
         OrderContract order_with_contract(order,contract) ;
         order_with_contract.place() ;
+        order_with_contract.enqueued_at = interactive::monotonic_ns() ;
         std::stringstream ss;
         boost::archive::text_oarchive oarch(ss);
         oarch << order_with_contract;
@@ -0,0 +1,192 @@
+/*
+ * File:   write_behind.hpp
+ * Author: Vladimir Venediktov
+ * Copyright (c) 2016-2018 Venediktes Gruppe, LLC
+ *
+ * Created on October 18, 2026, 9:15 AM
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*
+*/
+
+#ifndef __DATACACHE_WRITE_BEHIND_HPP__
+#define __DATACACHE_WRITE_BEHIND_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/log/trivial.hpp>
+
+namespace datacache {
+
+struct write_behind_options {
+    std::size_t capacity {4096}; // pending operations before push() has to wait
+    std::chrono::milliseconds backoff {1}; // longest a push() on a full queue sleeps before it looks again
+    std::size_t batch {256}; // most operations handed to apply at once
+    std::chrono::milliseconds idle {100}; // longest the writer sleeps , tick() runs at least this often
+};
+
+/*
+ * Write-behind stage for a single producer thread.
+ * push() only moves the operation into a lock-free SPSC queue , the writer thread
+ * takes up to batch of them in push order and hands them to apply , which is the
+ * only place the cache lock is taken , so the producer never waits for a reader
+ * holding the cache. tick() runs on the writer thread between batches for periodic
+ * work that should not hold the producer either.
+ * A full queue means the writer is stuck behind the cache lock , push() then sleeps
+ * until a batch is applied or backoff passes instead of spinning , stalls() counts it.
+ * Operations pushed before flush() are applied when it returns , the destructor
+ * applies whatever is left before joining the writer.
+ */
+template<typename Op>
+class write_behind {
+public:
+    using apply_t = std::function<void(std::vector<Op> &)> ;
+    using tick_t = std::function<void()> ;
+
+    write_behind(apply_t apply, tick_t tick, const write_behind_options &opts = write_behind_options()) :
+        _apply(std::move(apply)), _tick(std::move(tick)), _options(opts), _queue(opts.capacity),
+        _pushed(0), _applied(0), _stalls(0), _waiting(false), _stop(false), _mutex(), _wake(), _drained(), _writer() {
+        _writer = std::thread([this]() { run(); }) ;
+    }
+    ~write_behind() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex) ;
+            _stop = true ;
+        }
+        _wake.notify_one() ;
+        _writer.join() ;
+    }
+    write_behind(const write_behind &) = delete ;
+    write_behind & operator=(const write_behind &) = delete ;
+
+    // producer thread only
+    void push(const Op &op) {
+        if ( !_queue.push(op) ) {
+            stall(op) ;
+        }
+        ++_pushed ;
+        std::atomic_thread_fence(std::memory_order_seq_cst) ;
+        if ( _waiting.load(std::memory_order_relaxed) ) {
+            wake() ;
+        }
+    }
+
+    // producer thread only
+    void flush() {
+        wake() ;
+        std::unique_lock<std::mutex> lock(_mutex) ;
+        _drained.wait(lock, [this]() { return _applied.load(std::memory_order_acquire) >= _pushed ; }) ;
+    }
+
+    std::size_t pending() const {
+        return _queue.read_available() ;
+    }
+
+    // pushes that found the queue full
+    std::uint64_t stalls() const {
+        return _stalls.load(std::memory_order_relaxed) ;
+    }
+
+private:
+    // the writer notifies _drained after every batch , that is when space frees up
+    void stall(const Op &op) {
+        _stalls.fetch_add(1, std::memory_order_relaxed) ;
+        do {
+            std::unique_lock<std::mutex> lock(_mutex) ;
+            _wake.notify_one() ;
+            _drained.wait_for(lock, _options.backoff, [this]() { return _queue.write_available() > 0 ; }) ;
+        } while ( !_queue.push(op) ) ;
+    }
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(_mutex) ;
+        _wake.notify_one() ;
+    }
+
+    void run() {
+        std::vector<Op> batch ;
+        batch.reserve(_options.batch) ;
+        Op op ;
+        while ( true ) {
+            while ( batch.size() < _options.batch && _queue.pop(op) ) {
+                batch.push_back(std::move(op)) ;
+            }
+            if ( !batch.empty() ) {
+                try {
+                    _apply(batch) ;
+                } catch (const std::exception &e) {
+                    BOOST_LOG_TRIVIAL(error) << "write_behind dropped " << batch.size() << " operations , " << e.what() ;
+                }
+                std::size_t n = batch.size() ;
+                batch.clear() ;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex) ;
+                    _applied.fetch_add(n, std::memory_order_release) ;
+                }
+                _drained.notify_all() ;
+            }
+            run_tick() ;
+            std::unique_lock<std::mutex> lock(_mutex) ;
+            if ( _queue.read_available() ) {
+                continue ;
+            }
+            if ( _stop ) {
+                break ;
+            }
+            _waiting.store(true, std::memory_order_relaxed) ;
+            std::atomic_thread_fence(std::memory_order_seq_cst) ;
+            if ( !_queue.read_available() ) {
+                _wake.wait_for(lock, _options.idle) ;
+            }
+            _waiting.store(false, std::memory_order_relaxed) ;
+        }
+        _drained.notify_all() ;
+    }
+
+    void run_tick() {
+        if ( !_tick ) {
+            return ;
+        }
+        try {
+            _tick() ;
+        } catch (const std::exception &e) {
+            BOOST_LOG_TRIVIAL(error) << "write_behind tick " << e.what() ;
+        }
+    }
+
+    apply_t _apply ;
+    tick_t _tick ;
+    write_behind_options _options ;
+    boost::lockfree::spsc_queue<Op> _queue ;
+    std::uint64_t _pushed ; // producer side only
+    std::atomic<std::uint64_t> _applied ;
+    std::atomic<std::uint64_t> _stalls ;
+    std::atomic<bool> _waiting ;
+    bool _stop ;
+    std::mutex _mutex ;
+    std::condition_variable _wake ;
+    std::condition_variable _drained ;
+    std::thread _writer ;
+};
+
+}
+
+#endif /* __DATACACHE_WRITE_BEHIND_HPP__ */